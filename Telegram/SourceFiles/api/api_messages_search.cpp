@@ -11,6 +11,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_channel.h"
 #include "data/data_histories.h"
 #include "data/data_peer.h"
+#include "data/data_search_index.h"
 #include "data/data_session.h"
 #include "history/history.h"
 #include "history/history_item.h"
@@ -78,6 +79,7 @@ void MessagesSearch::searchRequest() {
 			searchReceived(it->second, _requestId, nextToken);
 			return;
 		}
+		searchLocal(nextToken);
 	}
 	auto callback = [=](Fn<void()> finish) {
 		const auto flags = _from
@@ -124,6 +126,26 @@ void MessagesSearch::searchRequest() {
 		std::move(callback));
 }
 
+void MessagesSearch::searchLocal(const QString &nextToken) {
+	auto messages = _history->owner().searchIndex().search(
+		_history,
+		_query,
+		_from,
+		kSearchPerPage);
+	if (messages.empty()) {
+		return;
+	}
+
+	// With a different token the first page from the server
+	// replaces the messages found locally instead of adding to them.
+	_messagesFounds.fire({
+		.total = -1,
+		.messages = std::move(messages),
+		.nextToken = nextToken + u"_local"_q,
+		.local = true,
+	});
+}
+
 void MessagesSearch::searchReceived(
 		const TLMessages &result,
 		mtpRequestId requestId,
@@ -17,6 +17,9 @@ struct FoundMessages {
 	int total = -1;
 	MessageIdsList messages;
 	QString nextToken;
+
+	// Found in the loaded messages while the server request is sent.
+	bool local = false;
 };
 
 class MessagesSearch final {
@@ -32,6 +35,7 @@ public:
 private:
 	using TLMessages = MTPmessages_Messages;
 	void searchRequest();
+	void searchLocal(const QString &nextToken);
 	void searchReceived(
 		const TLMessages &result,
 		mtpRequestId requestId,
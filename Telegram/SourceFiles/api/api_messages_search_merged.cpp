@@ -43,7 +43,11 @@ MessagesSearchMerged::MessagesSearchMerged(not_null<History*> history)
 
 	_apiSearch.messagesFounds(
 	) | rpl::start_with_next([=](const FoundMessages &data) {
-		if (data.nextToken == _concatedFound.nextToken) {
+		if (data.local) {
+			// Shown until the first page from the server replaces them.
+			_concatedFound = data;
+			_localFounds.fire({});
+		} else if (data.nextToken == _concatedFound.nextToken) {
 			addFound(data);
 			checkFull(data);
 			_nextFounds.fire({});
@@ -57,7 +61,9 @@ MessagesSearchMerged::MessagesSearchMerged(not_null<History*> history)
 	if (_migratedSearch) {
 		_migratedSearch->messagesFounds(
 		) | rpl::start_with_next([=](const FoundMessages &data) {
-			if (_isFull) {
+			if (data.local) {
+				return;
+			} else if (_isFull) {
 				addFound(data);
 			}
 			if (data.nextToken == _migratedFirstFound.nextToken) {
@@ -101,6 +107,10 @@ void MessagesSearchMerged::searchMore() {
 	}
 }
 
+rpl::producer<> MessagesSearchMerged::localFounds() const {
+	return _localFounds.events();
+}
+
 rpl::producer<> MessagesSearchMerged::newFounds() const {
 	return _newFounds.events();
 }
@@ -34,6 +34,7 @@ public:
 
 	[[nodiscard]] const FoundMessages &messages() const;
 
+	[[nodiscard]] rpl::producer<> localFounds() const;
 	[[nodiscard]] rpl::producer<> newFounds() const;
 	[[nodiscard]] rpl::producer<> nextFounds() const;
 
@@ -50,6 +51,7 @@ private:
 	bool _waitingForTotal = false;
 	bool _isFull = false;
 
+	rpl::event_stream<> _localFounds;
 	rpl::event_stream<> _newFounds;
 	rpl::event_stream<> _nextFounds;
 
@@ -48,6 +48,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "core/application.h"
 #include "storage/storage_account.h"
 #include "storage/storage_facade.h"
+#include "storage/storage_history_cache.h"
 #include "storage/storage_user_photos.h"
 #include "storage/storage_shared_media.h"
 #include "calls/calls_instance.h"
@@ -72,6 +73,11 @@ constexpr auto kNoUpdatesTimeout = 60 * 1000;
 // If nothing is received in 1 min when was a sleepmode we ping.
 constexpr auto kNoUpdatesAfterSleepTimeout = 60 * crl::time(1000);
 
+// Time to spend on adding messages from a difference in one event loop
+// iteration, checked after each portion of messages.
+constexpr auto kApplyDifferenceSlice = crl::time(8);
+constexpr auto kApplyDifferencePortion = 16;
+
 enum class DataIsLoadedResult {
 	NotLoaded = 0,
 	FromNotLoaded = 1,
@@ -126,6 +132,70 @@ bool HasForceLogoutNotification(const MTPUpdates &updates) {
 	return false;
 }
 
+// Some updates only carry the current value of something and don't have
+// pts, so from a long vector of them (after joining many channels or in
+// a big difference) only the last one for the same entity is applied.
+using SupersedeKey = std::tuple<mtpTypeId, uint64, int>;
+
+[[nodiscard]] std::optional<SupersedeKey> LookupSupersedeKey(
+		const MTPUpdate &update) {
+	const auto type = update.type();
+	switch (type) {
+	case mtpc_updateChannelMessageViews: {
+		const auto &d = update.c_updateChannelMessageViews();
+		return SupersedeKey{ type, d.vchannel_id().v, d.vid().v };
+	}
+	case mtpc_updateChannelMessageForwards: {
+		const auto &d = update.c_updateChannelMessageForwards();
+		return SupersedeKey{ type, d.vchannel_id().v, d.vid().v };
+	}
+	case mtpc_updateUserStatus: {
+		const auto &d = update.c_updateUserStatus();
+		return SupersedeKey{ type, d.vuser_id().v, 0 };
+	}
+	case mtpc_updateChannel: {
+		const auto &d = update.c_updateChannel();
+		return SupersedeKey{ type, d.vchannel_id().v, 0 };
+	}
+	}
+	return std::nullopt;
+}
+
+void RemoveSupersededUpdates(QVector<MTPUpdate> &list) {
+	const auto count = int(list.size());
+	auto keyed = std::vector<std::pair<SupersedeKey, int>>();
+	for (auto i = 0; i != count; ++i) {
+		if (const auto key = LookupSupersedeKey(list[i])) {
+			keyed.emplace_back(*key, i);
+		}
+	}
+	if (keyed.size() < 2) {
+		return;
+	}
+
+	// Sorted once, all but the last update for each key are superseded.
+	ranges::sort(keyed);
+	auto superseded = std::vector<bool>(count, false);
+	auto removed = 0;
+	for (auto i = 1; i != int(keyed.size()); ++i) {
+		if (keyed[i - 1].first == keyed[i].first) {
+			superseded[keyed[i - 1].second] = true;
+			++removed;
+		}
+	}
+	if (!removed) {
+		return;
+	}
+	auto result = QVector<MTPUpdate>();
+	result.reserve(count - removed);
+	for (auto i = 0; i != count; ++i) {
+		if (!superseded[i]) {
+			result.push_back(list[i]);
+		}
+	}
+	list = std::move(result);
+}
+
 bool ForwardedInfoDataLoaded(
 		not_null<Main::Session*> session,
 		const MTPMessageFwdHeader &header) {
@@ -231,6 +301,7 @@ Updates::Updates(not_null<Main::Session*> session)
 , _bySeqTimer([=] { getDifference(); })
 , _byMinChannelTimer([=] { getDifference(); })
 , _failDifferenceTimer([=] { getDifferenceAfterFail(); })
+, _applyDifferenceTimer([=] { applyDifferenceMessages(); })
 , _idleFinishTimer([=] { checkIdleFinish(); }) {
 	_ptsWaiter.setRequesting(true);
 
@@ -310,6 +381,7 @@ void Updates::feedUpdateVector(
 	} else if (policy == SkipUpdatePolicy::SkipExceptGroupCallParticipants) {
 		return;
 	}
+	RemoveSupersededUpdates(list);
 	for (const auto &entry : std::as_const(list)) {
 		const auto type = entry.type();
 		if ((policy == SkipUpdatePolicy::SkipMessageIds
@@ -474,23 +546,34 @@ void Updates::differenceDone(const MTPupdates_Difference &result) {
 	} break;
 	case mtpc_updates_differenceSlice: {
 		auto &d = result.c_updates_differenceSlice();
-		feedDifference(d.vusers(), d.vchats(), d.vnew_messages(), d.vother_updates());
-
-		auto &s = d.vintermediate_state().c_updates_state();
-		setState(s.vpts().v, s.vdate().v, s.vqts().v, s.vseq().v);
+		const auto state = d.vintermediate_state();
+		const auto applied = [=] {
+			auto &s = state.c_updates_state();
+			setState(s.vpts().v, s.vdate().v, s.vqts().v, s.vseq().v);
 
-		_ptsWaiter.setRequesting(false);
+			_ptsWaiter.setRequesting(false);
 
-		MTP_LOG(0, ("getDifference "
-			"{ good - after a slice of difference was received }%1"
-			).arg(_session->mtp().isTestMode() ? " TESTMODE" : ""));
-		getDifference();
+			MTP_LOG(0, ("getDifference "
+				"{ good - after a slice of difference was received }%1"
+				).arg(_session->mtp().isTestMode() ? " TESTMODE" : ""));
+			getDifference();
+		};
+		feedDifference(
+			d.vusers(),
+			d.vchats(),
+			d.vnew_messages(),
+			d.vother_updates(),
+			applied);
 	} break;
 	case mtpc_updates_difference: {
 		auto &d = result.c_updates_difference();
-		feedDifference(d.vusers(), d.vchats(), d.vnew_messages(), d.vother_updates());
-
-		stateDone(d.vstate());
+		const auto state = d.vstate();
+		feedDifference(
+			d.vusers(),
+			d.vchats(),
+			d.vnew_messages(),
+			d.vother_updates(),
+			[=] { stateDone(state); });
 	} break;
 	case mtpc_updates_differenceTooLong: {
 		LOG(("API Error: updates.differenceTooLong is not supported by 64Gram Desktop!"));
@@ -587,13 +670,95 @@ void Updates::feedDifference(
 		const MTPVector<MTPUser> &users,
 		const MTPVector<MTPChat> &chats,
 		const MTPVector<MTPMessage> &msgs,
-		const MTPVector<MTPUpdate> &other) {
+		const MTPVector<MTPUpdate> &other,
+		Fn<void()> done) {
 	Core::App().checkAutoLock();
 	session().data().processUsers(users);
 	session().data().processChats(chats);
 	feedMessageIds(other);
-	session().data().processMessages(msgs, NewMessageType::Unread);
-	feedUpdateVector(other, SkipUpdatePolicy::SkipMessageIds);
+
+	_differenceMessages = prioritizeDifferenceMessages(msgs.v);
+	_differenceMessagesApplied = 0;
+	_differenceApplied = [=] {
+		feedUpdateVector(other, SkipUpdatePolicy::SkipMessageIds);
+		done();
+	};
+	applyDifferenceMessages();
+}
+
+QVector<MTPMessage> Updates::prioritizeDifferenceMessages(
+		const QVector<MTPMessage> &messages) const {
+	// Open chats first, then pinned, then unmuted, then the rest.
+	const auto priority = [&](PeerId peerId) {
+		for (const auto &[key, tracker] : _activeChats) {
+			if (tracker.peer && tracker.peer->id == peerId) {
+				return 0;
+			}
+		}
+		const auto history = session().data().historyLoaded(peerId);
+		return !history
+			? 3
+			: history->isPinnedDialog(FilterId())
+			? 1
+			: history->muted()
+			? 3
+			: 2;
+	};
+	auto priorities = base::flat_map<PeerId, int>();
+	auto indices = std::vector<std::tuple<int, PeerId, uint32, int>>();
+	indices.reserve(messages.size());
+	for (auto i = 0, count = int(messages.size()); i != count; ++i) {
+		const auto &message = messages[i];
+		const auto peerId = PeerFromMessage(message);
+		auto j = priorities.find(peerId);
+		if (j == end(priorities)) {
+			j = priorities.emplace(peerId, priority(peerId)).first;
+		}
+		// Only 32 bit values here, same as in Data::Session.
+		const auto id = uint32(IdFromMessage(message).bare);
+		indices.emplace_back(j->second, peerId, id, i);
+	}
+	ranges::sort(indices);
+
+	auto result = QVector<MTPMessage>();
+	result.reserve(messages.size());
+	for (const auto &entry : indices) {
+		result.push_back(messages[std::get<3>(entry)]);
+	}
+	return result;
+}
+
+void Updates::applyDifferenceMessages() {
+	const auto till = crl::now() + kApplyDifferenceSlice;
+	const auto count = int(_differenceMessages.size());
+	while (_differenceMessagesApplied < count) {
+		const auto from = _differenceMessagesApplied;
+		_differenceMessagesApplied = std::min(
+			from + kApplyDifferencePortion,
+			count);
+		session().data().processMessages(
+			_differenceMessages.mid(from, _differenceMessagesApplied - from),
+			NewMessageType::Unread);
+		if (_differenceMessagesApplied < count && crl::now() >= till) {
+			session().data().sendHistoryChangeNotifications();
+			_applyDifferenceTimer.callOnce(0);
+			return;
+		}
+	}
+	_differenceMessages.clear();
+	_differenceMessagesApplied = 0;
+	if (const auto applied = base::take(_differenceApplied)) {
+		applied();
+	}
+	for (const auto &updates : base::take(_heldUpdates)) {
+		applyUpdates(updates);
+	}
+	if (base::take(_getDifferenceAfterApplied)) {
+		MTP_LOG(0, ("getDifference "
+			"{ good - requested while applying the difference }%1"
+			).arg(_session->mtp().isTestMode() ? " TESTMODE" : ""));
+		getDifference();
+	}
 }
 
 void Updates::differenceFail(const MTP::Error &error) {
@@ -663,7 +828,10 @@ void Updates::getDifferenceAfterFail() {
 void Updates::getDifference() {
 	_getDifferenceTimeByPts = 0;
 
-	if (requestingDifference()) {
+	if (_differenceApplied) {
+		_getDifferenceAfterApplied = true;
+		return;
+	} else if (requestingDifference()) {
 		return;
 	}
 
@@ -849,14 +1017,31 @@ void Updates::mtpUpdateReceived(const MTPUpdates &updates) {
 	Core::App().checkAutoLock();
 	_lastUpdateTime = crl::now();
 	_noUpdatesTimer.callOnce(kNoUpdatesTimeout);
-	if (!requestingDifference()
-		|| HasForceLogoutNotification(updates)) {
+	if (HasForceLogoutNotification(updates)) {
 		applyUpdates(updates);
-	} else {
+	} else if (requestingDifference()) {
 		applyGroupCallParticipantUpdates(updates);
+	} else if (_differenceApplied) {
+		holdUpdates(updates);
+	} else {
+		applyUpdates(updates);
 	}
 }
 
+void Updates::holdUpdates(const MTPUpdates &updates) {
+	// Users and chats are known at once, so that the results of our own
+	// requests can refer to them while the difference is being applied.
+	updates.match([&](const MTPDupdates &data) {
+		session().data().processUsers(data.vusers());
+		session().data().processChats(data.vchats());
+	}, [&](const MTPDupdatesCombined &data) {
+		session().data().processUsers(data.vusers());
+		session().data().processChats(data.vchats());
+	}, [](const auto &) {
+	});
+	_heldUpdates.push_back(updates);
+}
+
 void Updates::applyGroupCallParticipantUpdates(const MTPUpdates &updates) {
 	updates.match([&](const MTPDupdates &data) {
 		session().data().processUsers(data.vusers());
@@ -1266,6 +1451,8 @@ void Updates::applyUpdateNoPtsCheck(const MTPUpdate &update) {
 
 	case mtpc_updateDeleteMessages: {
 		auto &d = update.c_updateDeleteMessages();
+		_session->data().historyCache().invalidateNonChannelDeleted(
+			d.vmessages().v);
 		_session->data().processNonChannelMessagesDeleted(d.vmessages().v);
 	} break;
 
@@ -1290,6 +1477,7 @@ void Updates::applyUpdateNoPtsCheck(const MTPUpdate &update) {
 
 	case mtpc_updateEditChannelMessage: {
 		auto &d = update.c_updateEditChannelMessage();
+		_session->data().historyCache().invalidateEdited(d.vmessage());
 		_session->data().updateEditedMessage(d.vmessage());
 	} break;
 
@@ -1306,6 +1494,7 @@ void Updates::applyUpdateNoPtsCheck(const MTPUpdate &update) {
 
 	case mtpc_updateEditMessage: {
 		auto &d = update.c_updateEditMessage();
+		_session->data().historyCache().invalidateEdited(d.vmessage());
 		_session->data().updateEditedMessage(d.vmessage());
 	} break;
 
@@ -1316,9 +1505,11 @@ void Updates::applyUpdateNoPtsCheck(const MTPUpdate &update) {
 
 	case mtpc_updateDeleteChannelMessages: {
 		auto &d = update.c_updateDeleteChannelMessages();
-		_session->data().processMessagesDeleted(
-			peerFromChannel(d.vchannel_id().v),
+		const auto peerId = peerFromChannel(d.vchannel_id().v);
+		_session->data().historyCache().invalidateDeleted(
+			peerId,
 			d.vmessages().v);
+		_session->data().processMessagesDeleted(peerId, d.vmessages().v);
 	} break;
 
 	case mtpc_updatePinnedMessages: {
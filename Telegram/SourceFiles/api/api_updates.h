@@ -108,7 +108,11 @@ private:
 		const MTPVector<MTPUser> &users,
 		const MTPVector<MTPChat> &chats,
 		const MTPVector<MTPMessage> &msgs,
-		const MTPVector<MTPUpdate> &other);
+		const MTPVector<MTPUpdate> &other,
+		Fn<void()> done);
+	[[nodiscard]] QVector<MTPMessage> prioritizeDifferenceMessages(
+		const QVector<MTPMessage> &messages) const;
+	void applyDifferenceMessages();
 	void stateDone(const MTPupdates_State &state);
 	void setState(int32 pts, int32 date, int32 qts, int32 seq);
 	void channelDifferenceDone(
@@ -131,6 +135,7 @@ private:
 	void feedUpdate(const MTPUpdate &update);
 
 	void applyGroupCallParticipantUpdates(const MTPUpdates &updates);
+	void holdUpdates(const MTPUpdates &updates);
 
 	bool whenGetDiffChanged(
 		ChannelData *channel,
@@ -189,6 +194,18 @@ private:
 		crl::time> _channelFailDifferenceTimeout;
 	base::Timer _failDifferenceTimer;
 
+	// New messages from a big difference are added by parts between
+	// the frames, the rest of the difference is applied after them.
+	QVector<MTPMessage> _differenceMessages;
+	int _differenceMessagesApplied = 0;
+	Fn<void()> _differenceApplied;
+	base::Timer _applyDifferenceTimer;
+
+	// Updates pushed meanwhile may refer to the messages not added yet,
+	// so they are applied only after the whole difference.
+	std::vector<MTPUpdates> _heldUpdates;
+	bool _getDifferenceAfterApplied = false;
+
 	base::flat_map<
 		not_null<ChannelData*>,
 		mtpRequestId> _rangeDifferenceRequests;
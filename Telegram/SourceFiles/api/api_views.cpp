@@ -96,7 +96,7 @@ void ViewsManager::viewsIncrement() {
 			done(ids, result, requestId);
 		}).fail([=](const MTP::Error &error, mtpRequestId requestId) {
 			fail(error, requestId);
-		}).afterDelay(5).send();
+		}).afterDelay(5).background().send();
 
 		_incrementRequests.emplace(i->first, requestId);
 		i = _toIncrement.erase(i);
@@ -179,7 +179,7 @@ void ViewsManager::sendPollRequests(
 			finish(id);
 		}).fail([=](const MTP::Error &error, mtpRequestId id) {
 			finish(id);
-		}).send();
+		}).background().send();
 
 		_pollRequests[peer].id = requestId;
 	}
@@ -277,7 +277,9 @@ const base::flat_set<not_null<History*>> &ChatFilter::never() const {
 	return _never;
 }
 
-bool ChatFilter::contains(not_null<History*> history) const {
+auto ChatFilter::HistoryFlags(
+		not_null<History*> history,
+		Flags mask) -> Flags {
 	const auto flag = [&] {
 		const auto peer = history->peer;
 		if (const auto user = peer->asUser()) {
@@ -295,28 +297,53 @@ bool ChatFilter::contains(not_null<History*> history) const {
 				return Flag::Groups;
 			}
 		} else {
-			Unexpected("Peer type in ChatFilter::contains.");
+			Unexpected("Peer type in ChatFilter::HistoryFlags.");
 		}
 	}();
+	const auto state = (mask & (Flag::NoMuted | Flag::NoRead))
+		? history->chatListBadgesState()
+		: Dialogs::BadgesState();
+	const auto notArchived = history->folderKnown() && !history->folder();
+	auto result = Flags(flag);
+	if ((mask & Flag::NoMuted)
+		&& (!history->muted() || (state.mention && notArchived))) {
+		result |= Flag::NoMuted;
+	}
+	if ((mask & Flag::NoRead)
+		&& (state.unread
+			|| state.mention
+			|| history->fakeUnreadWhileOpened())) {
+		result |= Flag::NoRead;
+	}
+	if (notArchived) {
+		result |= Flag::NoArchived;
+	}
+	return result;
+}
+
+bool ChatFilter::contains(not_null<History*> history) const {
+	return contains(history, HistoryFlags(history, _flags));
+}
+
+bool ChatFilter::contains(
+		not_null<History*> history,
+		Flags historyFlags) const {
+	constexpr auto kTypes = Flag::Contacts
+		| Flag::NonContacts
+		| Flag::Groups
+		| Flag::Channels
+		| Flag::Bots;
+	constexpr auto kConditions = Flag::NoMuted
+		| Flag::NoRead
+		| Flag::NoArchived;
+
 	if (_never.contains(history)) {
 		return false;
 	}
-	const auto state = (_flags & (Flag::NoMuted | Flag::NoRead))
-		? history->chatListBadgesState()
-		: Dialogs::BadgesState();
+	const auto conditions = (_flags & kConditions);
 	return false
-		|| ((_flags & flag)
-			&& (!(_flags & Flag::NoMuted)
-				|| !history->muted()
-				|| (state.mention
-					&& history->folderKnown()
-					&& !history->folder()))
-			&& (!(_flags & Flag::NoRead)
-				|| state.unread
-				|| state.mention
-				|| history->fakeUnreadWhileOpened())
-			&& (!(_flags & Flag::NoArchived)
-				|| (history->folderKnown() && !history->folder())))
+		|| ((_flags & historyFlags & kTypes)
+			&& ((historyFlags & conditions) == conditions))
 		|| _always.contains(history);
 }
 
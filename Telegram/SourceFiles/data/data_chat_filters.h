@@ -74,7 +74,16 @@ public:
 	[[nodiscard]] const std::vector<not_null<History*>> &pinned() const;
 	[[nodiscard]] const base::flat_set<not_null<History*>> &never() const;
 
+	// Flags of the conditions that the history satisfies, computed once
+	// for checking it against all the filters in a row.
+	[[nodiscard]] static Flags HistoryFlags(
+		not_null<History*> history,
+		Flags mask);
+
 	[[nodiscard]] bool contains(not_null<History*> history) const;
+	[[nodiscard]] bool contains(
+		not_null<History*> history,
+		Flags historyFlags) const;
 
 private:
 	FilterId _id = 0;
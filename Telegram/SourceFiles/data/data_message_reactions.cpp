@@ -933,7 +933,7 @@ void Reactions::pollCollected() {
 			finalize();
 		}).fail([=] {
 			finalize();
-		}).send();
+		}).background().send();
 	}
 }
 
@@ -0,0 +1,150 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "data/data_search_index.h"
+
+#include "history/history.h"
+#include "history/history_item.h"
+
+namespace Data {
+namespace {
+
+// Long posts are found by their beginning, the server finds the rest.
+constexpr auto kMaxWordsPerItem = 256;
+
+} // namespace
+
+SearchIndex::SearchIndex() = default;
+
+SearchIndex::~SearchIndex() = default;
+
+void SearchIndex::registerMessage(not_null<HistoryItem*> item) {
+	_indices[item->history()].pending.emplace(item);
+}
+
+void SearchIndex::unregisterMessage(not_null<HistoryItem*> item) {
+	const auto i = _indices.find(item->history());
+	if (i == end(_indices)) {
+		return;
+	}
+	auto &index = i->second;
+	index.pending.erase(item);
+	Remove(index, item);
+	if (index.pending.empty() && index.words.empty()) {
+		_indices.erase(i);
+	}
+}
+
+void SearchIndex::refreshMessage(not_null<HistoryItem*> item) {
+	const auto i = _indices.find(item->history());
+	if (i != end(_indices) && i->second.words.contains(item)) {
+		Remove(i->second, item);
+		i->second.pending.emplace(item);
+	}
+}
+
+void SearchIndex::IndexPending(Index &index) {
+	for (const auto &item : base::take(index.pending)) {
+		Add(index, item);
+	}
+}
+
+void SearchIndex::Add(Index &index, not_null<HistoryItem*> item) {
+	auto &words = index.words[item];
+	if (item->isService()) {
+		return;
+	}
+	words = TextUtilities::PrepareSearchWords(item->originalText().text);
+	words.removeDuplicates();
+	if (words.size() > kMaxWordsPerItem) {
+		words.erase(words.begin() + kMaxWordsPerItem, words.end());
+	}
+	for (const auto &word : std::as_const(words)) {
+		index.items[word].emplace(item);
+	}
+}
+
+void SearchIndex::Remove(Index &index, not_null<HistoryItem*> item) {
+	const auto i = index.words.find(item);
+	if (i == end(index.words)) {
+		return;
+	}
+	for (const auto &word : std::as_const(i->second)) {
+		const auto j = index.items.find(word);
+		if (j != end(index.items)) {
+			j->second.erase(item);
+			if (j->second.empty()) {
+				index.items.erase(j);
+			}
+		}
+	}
+	index.words.erase(i);
+}
+
+std::unordered_set<not_null<HistoryItem*>> SearchIndex::Collect(
+		const Index &index,
+		const QString &prefix) {
+	auto result = std::unordered_set<not_null<HistoryItem*>>();
+	const auto &items = index.items;
+	for (auto i = items.lower_bound(prefix); i != end(items); ++i) {
+		if (!i->first.startsWith(prefix)) {
+			break;
+		}
+		result.insert(begin(i->second), end(i->second));
+	}
+	return result;
+}
+
+MessageIdsList SearchIndex::search(
+		not_null<History*> history,
+		const QString &query,
+		PeerData *from,
+		int limit) {
+	const auto words = TextUtilities::PrepareSearchWords(query);
+	const auto i = _indices.find(history);
+	if (words.isEmpty() || i == end(_indices)) {
+		return {};
+	}
+	auto &index = i->second;
+	IndexPending(index);
+
+	auto found = Collect(index, words.front());
+	for (const auto &word : words.mid(1)) {
+		if (found.empty()) {
+			break;
+		}
+		const auto other = Collect(index, word);
+		for (auto j = begin(found); j != end(found);) {
+			if (other.contains(*j)) {
+				++j;
+			} else {
+				j = found.erase(j);
+			}
+		}
+	}
+
+	auto items = std::vector<not_null<HistoryItem*>>();
+	items.reserve(found.size());
+	for (const auto &item : found) {
+		if (item->isRegular() && (!from || item->from() == from)) {
+			items.push_back(item);
+		}
+	}
+	ranges::sort(items, ranges::greater(), &HistoryItem::id);
+	if (int(items.size()) > limit) {
+		items.erase(begin(items) + limit, end(items));
+	}
+	return items | ranges::views::transform(
+		&HistoryItem::fullId
+	) | ranges::to_vector;
+}
+
+void SearchIndex::clear() {
+	_indices.clear();
+}
+
+} // namespace Data
@@ -0,0 +1,60 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+class History;
+class HistoryItem;
+class PeerData;
+
+namespace Data {
+
+// Word index of the message texts we have in memory, so that a search
+// can show the loaded messages it finds before the server answers.
+class SearchIndex final {
+public:
+	SearchIndex();
+	~SearchIndex();
+
+	// Items are indexed lazily, on the first search after they were
+	// registered, so loading history doesn't pay for splitting the texts.
+	void registerMessage(not_null<HistoryItem*> item);
+	void unregisterMessage(not_null<HistoryItem*> item);
+	void refreshMessage(not_null<HistoryItem*> item);
+
+	// Newest first, only server-side messages, same as in the API.
+	[[nodiscard]] MessageIdsList search(
+		not_null<History*> history,
+		const QString &query,
+		PeerData *from,
+		int limit);
+
+	void clear();
+
+private:
+	struct Index {
+		std::map<QString, std::unordered_set<not_null<HistoryItem*>>> items;
+
+		// All indexed items, with an empty list for the ones without text.
+		std::unordered_map<not_null<HistoryItem*>, QStringList> words;
+		std::unordered_set<not_null<HistoryItem*>> pending;
+	};
+
+	static void IndexPending(Index &index);
+	static void Add(Index &index, not_null<HistoryItem*> item);
+	static void Remove(Index &index, not_null<HistoryItem*> item);
+
+	[[nodiscard]] static std::unordered_set<not_null<HistoryItem*>> Collect(
+		const Index &index,
+		const QString &prefix);
+
+	// Searches are done in a single chat, so only its items get indexed.
+	std::unordered_map<not_null<History*>, Index> _indices;
+
+};
+
+} // namespace Data
@@ -34,6 +34,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "inline_bots/inline_bot_layout_item.h"
 #include "storage/storage_account.h"
 #include "storage/storage_encrypted_file.h"
+#include "storage/storage_history_cache.h"
 #include "media/player/media_player_instance.h" // instance()->play()
 #include "media/audio/media_audio.h"
 #include "boxes/abstract_box.h"
@@ -60,6 +61,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_replies_list.h"
 #include "data/data_chat_filters.h"
 #include "data/data_scheduled_messages.h"
+#include "data/data_search_index.h"
 #include "data/data_send_action.h"
 #include "data/data_sponsored_messages.h"
 #include "data/data_message_reactions.h"
@@ -269,9 +271,12 @@ Session::Session(not_null<Main::Session*> session)
 , _forumIcons(std::make_unique<ForumIcons>(this))
 , _notifySettings(std::make_unique<NotifySettings>(this))
 , _customEmojiManager(std::make_unique<CustomEmojiManager>(this))
-, _stories(std::make_unique<Stories>(this)) {
+, _stories(std::make_unique<Stories>(this))
+, _historyCache(std::make_unique<Storage::HistoryCache>(this))
+, _searchIndex(std::make_unique<SearchIndex>()) {
 	_cache->open(_session->local().cacheKey());
 	_bigFileCache->open(_session->local().cacheBigFileKey());
+	_historyCache->preload();
 
 	if constexpr (Platform::IsLinux()) {
 		const auto wasVersion = _session->local().oldMapVersion();
@@ -384,6 +389,7 @@ void Session::clear() {
 	_dependentMessages.clear();
 	base::take(_messages);
 	base::take(_nonChannelMessages);
+	_searchIndex->clear();
 	_messageByRandomId.clear();
 	_sentMessagesData.clear();
 	cSetRecentInlineBots(RecentInlineBots());
@@ -1744,6 +1750,7 @@ rpl::producer<not_null<HistoryItem*>> Session::itemDataChanges() const {
 }
 
 void Session::requestItemTextRefresh(not_null<HistoryItem*> item) {
+	_searchIndex->refreshMessage(item);
 	if (const auto i = _views.find(item); i != _views.end()) {
 		for (const auto &view : i->second) {
 			view->itemTextUpdated();
@@ -2283,6 +2290,7 @@ void Session::registerMessage(not_null<HistoryItem*> item) {
 	if (!peerIsChannel(peerId) && IsServerMsgId(itemId)) {
 		_nonChannelMessages.emplace(itemId, item);
 	}
+	_searchIndex->registerMessage(item);
 }
 
 void Session::registerMessageTTL(TimeId when, not_null<HistoryItem*> item) {
@@ -2406,6 +2414,7 @@ void Session::unregisterMessage(not_null<HistoryItem*> item) {
 		item,
 		Data::MessageUpdate::Flag::Destroyed);
 	groups().unregisterMessage(item);
+	_searchIndex->unregisterMessage(item);
 	removeDependencyMessage(item);
 	messagesListForInsert(peerId)->erase(itemId);
 
@@ -4181,14 +4190,20 @@ void Session::refreshChatListEntry(Dialogs::Key key) {
 	if (!history) {
 		return;
 	}
-	for (const auto &filter : _chatsFilters->list()) {
+	const auto &filters = _chatsFilters->list();
+	auto mask = ChatFilter::Flags();
+	for (const auto &filter : filters) {
+		mask |= filter.flags();
+	}
+	const auto historyFlags = ChatFilter::HistoryFlags(history, mask);
+	for (const auto &filter : filters) {
 		const auto id = filter.id();
 		if (!id) {
 			continue;
 		}
 		const auto filterList = chatsFilters().chatsList(id);
 		auto event = ChatListEntryRefresh{ .key = key, .filterId = id };
-		if (filter.contains(history)) {
+		if (filter.contains(history, historyFlags)) {
 			event.existenceChanged = !entry->inChatList(id);
 			if (event.existenceChanged) {
 				entry->addToChatList(id, filterList);
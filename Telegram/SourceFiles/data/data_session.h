@@ -37,6 +37,10 @@ namespace Ui {
 class BoxContent;
 } // namespace Ui
 
+namespace Storage {
+class HistoryCache;
+} // namespace Storage
+
 namespace Passport {
 struct SavedCredentials;
 } // namespace Passport
@@ -64,6 +68,7 @@ class GroupCall;
 class NotifySettings;
 class CustomEmojiManager;
 class Stories;
+class SearchIndex;
 
 struct RepliesReadTillUpdate {
 	FullMsgId id;
@@ -140,6 +145,12 @@ public:
 	[[nodiscard]] Stories &stories() const {
 		return *_stories;
 	}
+	[[nodiscard]] Storage::HistoryCache &historyCache() const {
+		return *_historyCache;
+	}
+	[[nodiscard]] SearchIndex &searchIndex() const {
+		return *_searchIndex;
+	}
 
 	[[nodiscard]] MsgId nextNonHistoryEntryId() {
 		return ++_nonHistoryEntryId;
@@ -1019,6 +1030,8 @@ private:
 	const std::unique_ptr<NotifySettings> _notifySettings;
 	const std::unique_ptr<CustomEmojiManager> _customEmojiManager;
 	const std::unique_ptr<Stories> _stories;
+	const std::unique_ptr<Storage::HistoryCache> _historyCache;
+	const std::unique_ptr<SearchIndex> _searchIndex;
 
 	MsgId _nonHistoryEntryId = ServerMaxMsgId.bare + ScheduledMsgIdsRange;
 
@@ -1251,7 +1251,7 @@ void Stories::sendIncrementViewsRequests() {
 		api->request(MTPstories_IncrementStoryViews(
 			_owner->peer(peer)->asUser()->inputUser,
 			MTP_vector<MTPint>(std::move(ids))
-		)).done(finish).fail(finish).send();
+		)).done(finish).fail(finish).background().send();
 		_incrementViewsPending.remove(peer);
 	}
 }
@@ -1633,7 +1633,7 @@ void Stories::requestReadTills() {
 		for (const auto &storyId : base::take(_pendingReadTillItems)) {
 			_owner->refreshStoryItemViews(storyId);
 		}
-	}).send();
+	}).background().send();
 }
 
 bool Stories::isUnread(not_null<Story*> story) {
@@ -22,6 +22,7 @@ constexpr auto kAudioAlbumThumbCacheTag = 0x0000000000000300ULL;
 constexpr auto kWebDocumentCacheTag = 0x0000020000000000ULL;
 constexpr auto kUrlCacheTag = 0x0000030000000000ULL;
 constexpr auto kGeoPointCacheTag = 0x0000040000000000ULL;
+constexpr auto kHistorySliceCacheTag = 0x0000050000000000ULL;
 
 } // namespace
 
@@ -95,6 +96,13 @@ Storage::Cache::Key AudioAlbumThumbCacheKey(
 	};
 }
 
+Storage::Cache::Key HistorySliceCacheKey(PeerId peerId) {
+	return Storage::Cache::Key{
+		Data::kHistorySliceCacheTag,
+		peerId.value,
+	};
+}
+
 } // namespace Data
 
 void MessageCursor::fillFrom(not_null<const Ui::InputField*> field) {
@@ -12,6 +12,62 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "history/history.h"
 
 namespace Dialogs {
+namespace {
+
+constexpr auto kTrigramSize = 3;
+
+[[nodiscard]] uint64 PackTrigram(QChar a, QChar b, QChar c) {
+	return (uint64(a.unicode()) << 32)
+		| (uint64(b.unicode()) << 16)
+		| uint64(c.unicode());
+}
+
+// Sorted and unique.
+[[nodiscard]] std::vector<uint64> CollectTrigrams(
+		const base::flat_set<QString> &words) {
+	auto result = std::vector<uint64>();
+	for (const auto &word : words) {
+		auto a = QChar(), b = QChar();
+		for (const auto &c : word) {
+			result.push_back(PackTrigram(a, b, c));
+			a = b;
+			b = c;
+		}
+	}
+	ranges::sort(result);
+	result.erase(ranges::unique(result), end(result));
+	return result;
+}
+
+// Short words are looked up as name word beginnings, others as infixes.
+[[nodiscard]] std::vector<uint64> QueryTrigrams(const QString &word) {
+	const auto size = int(word.size());
+	if (size == 1) {
+		return { PackTrigram(QChar(), QChar(), word[0]) };
+	} else if (size == 2) {
+		return { PackTrigram(QChar(), word[0], word[1]) };
+	}
+	auto result = std::vector<uint64>();
+	result.reserve(std::max(size - kTrigramSize + 1, 0));
+	for (auto i = 0; i + kTrigramSize <= size; ++i) {
+		result.push_back(PackTrigram(word[i], word[i + 1], word[i + 2]));
+	}
+	return result;
+}
+
+[[nodiscard]] bool MatchesWord(
+		const base::flat_set<QString> &nameWords,
+		const QString &word) {
+	const auto infix = (word.size() >= kTrigramSize);
+	for (const auto &name : nameWords) {
+		if (infix ? name.contains(word) : name.startsWith(word)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
 
 IndexedList::IndexedList(SortMode sortMode, FilterId filterId)
 : _sortMode(sortMode)
@@ -33,6 +89,7 @@ RowsByLetter IndexedList::addToEnd(Key key) {
 		}
 		result.letters.emplace(ch, j->second.addToEnd(key));
 	}
+	updateTrigrams(key);
 	return result;
 }
 
@@ -49,6 +106,7 @@ Row *IndexedList::addByName(Key key) {
 		}
 		j->second.addByName(key);
 	}
+	updateTrigrams(key);
 	return result;
 }
 
@@ -105,6 +163,9 @@ void IndexedList::peerNameChanged(
 		} else {
 			adjustNames(FilterId(), history, oldLetters);
 		}
+		if (_list.contains(history)) {
+			updateTrigrams(history);
+		}
 	}
 }
 
@@ -116,6 +177,9 @@ void IndexedList::peerNameChanged(
 
 	if (const auto history = peer->owner().historyLoaded(peer)) {
 		adjustNames(filterId, history, oldLetters);
+		if (_list.contains(history)) {
+			updateTrigrams(history);
+		}
 	}
 }
 
@@ -201,61 +265,102 @@ void IndexedList::remove(Key key, Row *replacedBy) {
 				it->second.remove(key, replacedBy);
 			}
 		}
+		removeTrigrams(key);
 	}
 }
 
 void IndexedList::clear() {
 	_list.clear();
 	_index.clear();
+	_trigrams.clear();
+	_trigramsByEntry.clear();
 }
 
-std::vector<not_null<Row*>> IndexedList::filtered(
-		const QStringList &words) const {
-	const auto minimal = [&]() -> const Dialogs::List* {
-		if (empty()) {
-			return nullptr;
+void IndexedList::updateTrigrams(Key key) {
+	const auto entry = key.entry();
+	auto now = CollectTrigrams(entry->chatListNameWords());
+	auto &was = _trigramsByEntry[entry];
+
+	// Both lists are sorted, so they are compared in a single pass.
+	auto i = begin(was);
+	auto j = begin(now);
+	while (i != end(was) || j != end(now)) {
+		if (j == end(now) || (i != end(was) && *i < *j)) {
+			removeTrigram(*i++, entry);
+		} else if (i == end(was) || *j < *i) {
+			_trigrams[*j++].emplace(entry);
+		} else {
+			++i;
+			++j;
 		}
-		auto result = (const Dialogs::List*)nullptr;
-		for (const auto &word : words) {
-			if (word.isEmpty()) {
-				continue;
-			}
-			const auto found = filtered(word[0]);
-			if (!found || found->empty()) {
+	}
+	was = std::move(now);
+}
+
+void IndexedList::removeTrigrams(Key key) {
+	const auto i = _trigramsByEntry.find(key.entry());
+	if (i == end(_trigramsByEntry)) {
+		return;
+	}
+	for (const auto trigram : i->second) {
+		removeTrigram(trigram, i->first);
+	}
+	_trigramsByEntry.erase(i);
+}
+
+void IndexedList::removeTrigram(Trigram trigram, not_null<Entry*> entry) {
+	const auto i = _trigrams.find(trigram);
+	if (i != end(_trigrams)) {
+		i->second.erase(entry);
+		if (i->second.empty()) {
+			_trigrams.erase(i);
+		}
+	}
+}
+
+auto IndexedList::filteredByTrigrams(const QStringList &words) const
+-> const std::unordered_set<not_null<Entry*>>* {
+	auto result = (const std::unordered_set<not_null<Entry*>>*)nullptr;
+	for (const auto &word : words) {
+		if (word.isEmpty()) {
+			continue;
+		}
+		for (const auto trigram : QueryTrigrams(word)) {
+			const auto i = _trigrams.find(trigram);
+			if (i == end(_trigrams)) {
 				return nullptr;
-			} else if (!result || result->size() > found->size()) {
-				result = found;
+			} else if (!result || result->size() > i->second.size()) {
+				result = &i->second;
 			}
 		}
-		return result;
-	}();
+	}
+	return result;
+}
+
+std::vector<not_null<Row*>> IndexedList::filtered(
+		const QStringList &words) const {
 	auto result = std::vector<not_null<Row*>>();
-	if (!minimal || minimal->empty()) {
+	const auto candidates = empty() ? nullptr : filteredByTrigrams(words);
+	if (!candidates) {
 		return result;
 	}
-	result.reserve(minimal->size());
-	for (const auto &row : *minimal) {
-		const auto &nameWords = row->entry()->chatListNameWords();
-		const auto found = [&](const QString &word) {
-			for (const auto &name : nameWords) {
-				if (name.startsWith(word)) {
-					return true;
-				}
-			}
-			return false;
-		};
-		const auto allFound = [&] {
-			for (const auto &word : words) {
-				if (!found(word)) {
-					return false;
-				}
-			}
-			return true;
-		}();
+	result.reserve(candidates->size());
+	for (const auto &entry : *candidates) {
+		const auto row = _list.getRow(entry);
+		if (!row) {
+			continue;
+		}
+		const auto &nameWords = entry->chatListNameWords();
+		const auto allFound = ranges::all_of(words, [&](const QString &word) {
+			return MatchesWord(nameWords, word);
+		});
 		if (allFound) {
 			result.push_back(row);
 		}
 	}
+	ranges::sort(result, ranges::less(), [](not_null<Row*> row) {
+		return row->index();
+	});
 	return result;
 }
 
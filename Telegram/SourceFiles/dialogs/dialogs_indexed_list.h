@@ -83,6 +83,10 @@ public:
 	[[nodiscard]] iterator findByY(int y) { return all().findByY(y); }
 
 private:
+	// Three characters packed, words are padded by zeros in front,
+	// so one and two character grams match the name word beginnings.
+	using Trigram = uint64;
+
 	void adjustByName(
 		Key key,
 		const base::flat_set<QChar> &oldChars);
@@ -91,10 +95,22 @@ private:
 		not_null<History*> history,
 		const base::flat_set<QChar> &oldChars);
 
+	void updateTrigrams(Key key);
+	void removeTrigrams(Key key);
+	void removeTrigram(Trigram trigram, not_null<Entry*> entry);
+	[[nodiscard]] auto filteredByTrigrams(const QStringList &words) const
+		-> const std::unordered_set<not_null<Entry*>>*;
+
 	SortMode _sortMode = SortMode();
 	FilterId _filterId = 0;
 	List _list, _empty;
 	base::flat_map<QChar, List> _index;
+	std::unordered_map<
+		Trigram,
+		std::unordered_set<not_null<Entry*>>> _trigrams;
+	std::unordered_map<
+		not_null<Entry*>,
+		std::vector<Trigram>> _trigramsByEntry; // Sorted.
 
 };
 
@@ -9,11 +9,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "export/export_settings.h"
 #include "export/data/export_data_types.h"
+#include "export/output/export_output_abstract.h"
 #include "export/output/export_output_result.h"
 #include "export/output/export_output_file.h"
 #include "mtproto/mtproto_response.h"
 #include "base/bytes.h"
 #include "base/random.h"
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
 #include <set>
 #include <deque>
 
@@ -22,8 +26,7 @@ namespace {
 
 constexpr auto kUserpicsSliceLimit = 100;
 constexpr auto kFileChunkSize = 1024 * 1024;
-constexpr auto kFileRequestsCount = 2;
-//constexpr auto kFileNextRequestDelay = crl::time(20);
+constexpr auto kFileRequestsCount = 4;
 constexpr auto kChatsSliceLimit = 100;
 constexpr auto kMessagesSliceLimit = 100;
 constexpr auto kTopPeerSliceLimit = 100;
@@ -105,6 +108,34 @@ private:
 
 };
 
+// Files downloaded by the previous runs of an export into the same folder,
+// so that an interrupted or repeated export doesn't download them again.
+class ApiWrap::FilesManifest {
+public:
+	using Location = Data::FileLocation;
+
+	explicit FilesManifest(const QString &folder);
+
+	void save(
+		const Location &location,
+		const QString &relativePath,
+		int64 size);
+	std::optional<QString> find(const Location &location) const;
+
+private:
+	struct Entry {
+		QString relativePath;
+		int64 size = 0;
+	};
+
+	void read();
+
+	QString _folder;
+	QFile _file;
+	std::map<LocationKey, Entry> _map;
+
+};
+
 struct ApiWrap::StartProcess {
 	FnMut<void(StartInfo)> done;
 
@@ -174,11 +205,15 @@ struct ApiWrap::FileProcess {
 	int64 offset = 0;
 	int64 size = 0;
 
+	// Parts are requested in parallel and written in order.
 	struct Request {
 		int64 offset = 0;
 		QByteArray bytes;
+		mtpRequestId requestId = 0;
 	};
 	std::deque<Request> requests;
+
+	// File reference refreshing, no parts are requested meanwhile.
 	mtpRequestId requestId = 0;
 };
 
@@ -337,6 +372,78 @@ std::optional<QString> ApiWrap::LoadedFileCache::find(
 	return std::nullopt;
 }
 
+ApiWrap::FilesManifest::FilesManifest(const QString &folder)
+: _folder(folder)
+, _file(Output::FilesManifestPath(folder)) {
+	read();
+}
+
+void ApiWrap::FilesManifest::read() {
+	if (!_file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	const auto content = _file.readAll();
+	_file.close();
+
+	// Each line is "type id size relative/path".
+	for (const auto &line : content.split('\n')) {
+		const auto parts = line.split(' ');
+		if (parts.size() < 4) {
+			continue;
+		}
+		auto key = LocationKey();
+		key.type = parts[0].toULongLong();
+		key.id = parts[1].toULongLong();
+		const auto size = parts[2].toLongLong();
+		const auto skip = parts[0].size() + parts[1].size() + parts[2].size();
+		const auto relativePath = QString::fromUtf8(line.mid(skip + 3));
+		if (size > 0 && !relativePath.isEmpty()) {
+			_map[key] = Entry{ relativePath, size };
+		}
+	}
+}
+
+void ApiWrap::FilesManifest::save(
+		const Location &location,
+		const QString &relativePath,
+		int64 size) {
+	if (!location || !size) {
+		return;
+	}
+	const auto key = ComputeLocationKey(location);
+	_map[key] = Entry{ relativePath, size };
+
+	if (!_file.isOpen() && !_file.open(QIODevice::Append)) {
+		LOG(("Export Error: Could not open files manifest '%1'."
+			).arg(_file.fileName()));
+		return;
+	}
+	_file.write(QByteArray::number(key.type)
+		+ ' '
+		+ QByteArray::number(key.id)
+		+ ' '
+		+ QByteArray::number(size)
+		+ ' '
+		+ relativePath.toUtf8()
+		+ '\n');
+	_file.flush();
+}
+
+std::optional<QString> ApiWrap::FilesManifest::find(
+		const Location &location) const {
+	if (!location) {
+		return std::nullopt;
+	}
+	const auto key = ComputeLocationKey(location);
+	const auto i = _map.find(key);
+	if (i == end(_map)
+		|| QFileInfo(_folder + i->second.relativePath).size()
+			!= i->second.size) {
+		return std::nullopt;
+	}
+	return i->second.relativePath;
+}
+
 ApiWrap::FileProcess::FileProcess(const QString &path, Output::Stats *stats)
 : file(path, stats) {
 }
@@ -381,7 +488,13 @@ auto ApiWrap::fileRequest(const Data::FileLocation &location, int64 offset) {
 			MTP_long(offset),
 			MTP_int(kFileChunkSize))
 	)).fail([=](const MTP::Error &result) {
-		_fileProcess->requestId = 0;
+		const auto i = ranges::find(
+			_fileProcess->requests,
+			offset,
+			&FileProcess::Request::offset);
+		if (i != end(_fileProcess->requests)) {
+			i->requestId = 0;
+		}
 		if (result.type() == u"TAKEOUT_FILE_EMPTY"_q
 			&& _otherDataProcess != nullptr) {
 			filePartDone(
@@ -398,6 +511,7 @@ auto ApiWrap::fileRequest(const Data::FileLocation &location, int64 offset) {
 			&& result.type().startsWith(u"FILE_REFERENCE_"_q)) {
 			filePartRefreshReference(offset);
 		} else {
+			cancelFileParts();
 			error(std::move(result));
 		}
 	}).toDC(MTP::ShiftDcId(location.dcId, MTP::kExportMediaDcShift)));
@@ -425,6 +539,7 @@ void ApiWrap::startExport(
 
 	_settings = std::make_unique<Settings>(settings);
 	_stats = stats;
+	_filesManifest = std::make_unique<FilesManifest>(_settings->path);
 	_startProcess = std::make_unique<StartProcess>();
 	_startProcess->done = std::move(done);
 
@@ -1243,9 +1358,10 @@ void ApiWrap::skipFile(uint64 randomId) {
 		return;
 	}
 	LOG(("Export Info: File skipped."));
-	Assert(!_fileProcess->requests.empty());
-	Assert(_fileProcess->requestId != 0);
-	_mtp.request(base::take(_fileProcess->requestId)).cancel();
+	cancelFileParts();
+	if (const auto requestId = base::take(_fileProcess->requestId)) {
+		_mtp.request(requestId).cancel();
+	}
 	base::take(_fileProcess)->done(QString());
 }
 
@@ -2009,6 +2125,11 @@ bool ApiWrap::processFileLoad(
 		// Don't load thumbs for large files that we skip.
 		file.skipReason = SkipReason::FileSize;
 		return true;
+	} else if (const auto path = _filesManifest->find(file.location)) {
+		// Downloaded by a previous export into the same folder.
+		file.relativePath = *path;
+		_fileCache->save(file.location, file.relativePath);
+		return true;
 	}
 	loadFile(file, origin, std::move(progress), std::move(done));
 	return false;
@@ -2029,6 +2150,10 @@ bool ApiWrap::writePreloadedFile(
 		if (const auto result = process->file.writeBlock(file.content)) {
 			file.relativePath = process->relativePath;
 			_fileCache->save(file.location, file.relativePath);
+			_filesManifest->save(
+				file.location,
+				file.relativePath,
+				file.content.size());
 		} else {
 			ioError(result);
 		}
@@ -2062,7 +2187,7 @@ void ApiWrap::loadFile(
 
 	loadFilePart();
 
-	Ensures(_fileProcess->requestId != 0);
+	Ensures(!_fileProcess->requests.empty());
 }
 
 auto ApiWrap::prepareFileProcess(
@@ -2086,37 +2211,43 @@ auto ApiWrap::prepareFileProcess(
 }
 
 void ApiWrap::loadFilePart() {
-	if (!_fileProcess
-		|| _fileProcess->requestId
-		|| _fileProcess->requests.size() >= kFileRequestsCount
-		|| (_fileProcess->size > 0
-			&& _fileProcess->offset >= _fileProcess->size)) {
-		return;
+	// With unknown size we request parts one by one until an empty one.
+	const auto canRequestMore = [&] {
+		return (_fileProcess->size > 0)
+			? (_fileProcess->offset < _fileProcess->size)
+			: _fileProcess->requests.empty();
+	};
+	while (_fileProcess
+		&& !_fileProcess->requestId
+		&& _fileProcess->requests.size() < kFileRequestsCount
+		&& canRequestMore()) {
+		const auto offset = _fileProcess->offset;
+		_fileProcess->requests.push_back({ offset });
+		_fileProcess->requests.back().requestId = fileRequest(
+			_fileProcess->location,
+			offset
+		).done([=](const MTPupload_File &result) {
+			filePartDone(offset, result);
+		}).send();
+		_fileProcess->offset += kFileChunkSize;
 	}
+}
 
-	const auto offset = _fileProcess->offset;
-	_fileProcess->requests.push_back({ offset });
-	_fileProcess->requestId = fileRequest(
-		_fileProcess->location,
-		_fileProcess->offset
-	).done([=](const MTPupload_File &result) {
-		_fileProcess->requestId = 0;
-		filePartDone(offset, result);
-	}).send();
-	_fileProcess->offset += kFileChunkSize;
+void ApiWrap::cancelFileParts(int64 fromOffset) {
+	Expects(_fileProcess != nullptr);
 
-	if (_fileProcess->size > 0
-		&& _fileProcess->requests.size() < kFileRequestsCount) {
-		// Only one request at a time supported right now.
-		//const auto runner = _runner;
-		//crl::on_main([=] {
-		//	QTimer::singleShot(kFileNextRequestDelay, [=] {
-		//		runner([=] {
-		//			loadFilePart();
-		//		});
-		//	});
-		//});
+	auto &requests = _fileProcess->requests;
+	for (auto i = begin(requests); i != end(requests);) {
+		if (i->offset < fromOffset) {
+			++i;
+			continue;
+		}
+		if (i->requestId) {
+			_mtp.request(i->requestId).cancel();
+		}
+		i = requests.erase(i);
 	}
+	_fileProcess->offset = std::min(_fileProcess->offset, fromOffset);
 }
 
 void ApiWrap::filePartDone(int64 offset, const MTPupload_File &result) {
@@ -2124,35 +2255,39 @@ void ApiWrap::filePartDone(int64 offset, const MTPupload_File &result) {
 	Expects(!_fileProcess->requests.empty());
 
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
+		cancelFileParts();
 		error("Cdn redirect is not supported.");
 		return;
 	}
 	const auto &data = result.c_upload_file();
 	if (data.vbytes().v.isEmpty()) {
 		if (_fileProcess->size > 0) {
+			cancelFileParts();
 			error("Empty bytes received in file part.");
 			return;
 		}
 		const auto result = _fileProcess->file.writeBlock({});
 		if (!result) {
+			cancelFileParts();
 			ioError(result);
 			return;
 		}
 	} else {
-		using Request = FileProcess::Request;
 		auto &requests = _fileProcess->requests;
 		const auto i = ranges::find(
 			requests,
 			offset,
-			[](const Request &request) { return request.offset; });
+			&FileProcess::Request::offset);
 		Assert(i != end(requests));
 
+		i->requestId = 0;
 		i->bytes = data.vbytes().v;
 
 		auto &file = _fileProcess->file;
 		while (!requests.empty() && !requests.front().bytes.isEmpty()) {
 			const auto &bytes = requests.front().bytes;
 			if (const auto result = file.writeBlock(bytes); !result) {
+				cancelFileParts();
 				ioError(result);
 				return;
 			}
@@ -2176,6 +2311,10 @@ void ApiWrap::filePartDone(int64 offset, const MTPupload_File &result) {
 	auto process = base::take(_fileProcess);
 	const auto relativePath = process->relativePath;
 	_fileCache->save(process->location, relativePath);
+	_filesManifest->save(
+		process->location,
+		relativePath,
+		process->file.size());
 	process->done(process->relativePath);
 }
 
@@ -2183,6 +2322,14 @@ void ApiWrap::filePartRefreshReference(int64 offset) {
 	Expects(_fileProcess != nullptr);
 	Expects(_fileProcess->requestId == 0);
 
+	// Parts after the first missing one will fail the same way,
+	// so we request all of them again with the refreshed reference.
+	const auto &requests = _fileProcess->requests;
+	const auto missing = ranges::find_if(requests, [](const auto &request) {
+		return request.bytes.isEmpty();
+	});
+	cancelFileParts((missing != end(requests)) ? missing->offset : offset);
+
 	const auto &origin = _fileProcess->origin;
 	if (origin.storyId) {
 		_fileProcess->requestId = mainRequest(MTPstories_GetStoriesByID(
@@ -2194,7 +2341,7 @@ void ApiWrap::filePartRefreshReference(int64 offset) {
 			return true;
 		}).done([=](const MTPstories_Stories &result) {
 			_fileProcess->requestId = 0;
-			filePartExtractReference(offset, result);
+			filePartExtractReference(result);
 		}).send();
 		return;
 	} else if (!origin.messageId) {
@@ -2222,7 +2369,7 @@ void ApiWrap::filePartRefreshReference(int64 offset) {
 			return true;
 		}).done([=](const MTPmessages_Messages &result) {
 			_fileProcess->requestId = 0;
-			filePartExtractReference(offset, result);
+			filePartExtractReference(result);
 		}).send();
 	} else {
 		_fileProcess->requestId = splitRequest(
@@ -2238,13 +2385,12 @@ void ApiWrap::filePartRefreshReference(int64 offset) {
 			return true;
 		}).done([=](const MTPmessages_Messages &result) {
 			_fileProcess->requestId = 0;
-			filePartExtractReference(offset, result);
+			filePartExtractReference(result);
 		}).send();
 	}
 }
 
 void ApiWrap::filePartExtractReference(
-		int64 offset,
 		const MTPmessages_Messages &result) {
 	Expects(_fileProcess != nullptr);
 	Expects(_fileProcess->requestId == 0);
@@ -2271,13 +2417,7 @@ void ApiWrap::filePartExtractReference(
 					_fileProcess->location,
 					message.thumb().file.location);
 				if (refresh1 || refresh2) {
-					_fileProcess->requestId = fileRequest(
-						_fileProcess->location,
-						offset
-					).done([=](const MTPupload_File &result) {
-						_fileProcess->requestId = 0;
-						filePartDone(offset, result);
-					}).send();
+					loadFilePart();
 					return;
 				}
 			}
@@ -2287,7 +2427,6 @@ void ApiWrap::filePartExtractReference(
 }
 
 void ApiWrap::filePartExtractReference(
-		int64 offset,
 		const MTPstories_Stories &result) {
 	Expects(_fileProcess != nullptr);
 	Expects(_fileProcess->requestId == 0);
@@ -2304,13 +2443,7 @@ void ApiWrap::filePartExtractReference(
 				_fileProcess->location,
 				story.thumb().file.location);
 			if (refresh1 || refresh2) {
-				_fileProcess->requestId = fileRequest(
-					_fileProcess->location,
-					offset
-				).done([=](const MTPupload_File &result) {
-					_fileProcess->requestId = 0;
-					filePartDone(offset, result);
-				}).send();
+				loadFilePart();
 				return;
 			}
 		}
@@ -2320,10 +2453,11 @@ void ApiWrap::filePartExtractReference(
 
 void ApiWrap::filePartUnavailable() {
 	Expects(_fileProcess != nullptr);
-	Expects(!_fileProcess->requests.empty());
 
 	LOG(("Export Error: File unavailable."));
 
+	cancelFileParts();
+
 	base::take(_fileProcess)->done(QString());
 }
 
@@ -103,6 +103,7 @@ public:
 
 private:
 	class LoadedFileCache;
+	class FilesManifest;
 	struct StartProcess;
 	struct ContactsProcess;
 	struct UserpicsProcess;
@@ -218,12 +219,9 @@ private:
 	void filePartDone(int64 offset, const MTPupload_File &result);
 	void filePartUnavailable();
 	void filePartRefreshReference(int64 offset);
-	void filePartExtractReference(
-		int64 offset,
-		const MTPmessages_Messages &result);
-	void filePartExtractReference(
-		int64 offset,
-		const MTPstories_Stories &result);
+	void filePartExtractReference(const MTPmessages_Messages &result);
+	void filePartExtractReference(const MTPstories_Stories &result);
+	void cancelFileParts(int64 fromOffset = 0);
 
 	template <typename Request>
 	class RequestBuilder;
@@ -252,6 +250,7 @@ private:
 
 	std::unique_ptr<StartProcess> _startProcess;
 	std::unique_ptr<LoadedFileCache> _fileCache;
+	std::unique_ptr<FilesManifest> _filesManifest;
 	std::unique_ptr<ContactsProcess> _contactsProcess;
 	std::unique_ptr<UserpicsProcess> _userpicsProcess;
 	std::unique_ptr<StoriesProcess> _storiesProcess;
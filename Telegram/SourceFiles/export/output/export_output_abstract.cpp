@@ -14,9 +14,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include <QtCore/QDir>
 #include <QtCore/QDate>
+#include <QtCore/QFile>
 
 namespace Export {
 namespace Output {
+namespace {
+
+constexpr auto kFilesManifestName = "export_files.txt";
+
+} // namespace
 
 QString NormalizePath(const Settings &settings) {
 	QDir folder(settings.path);
@@ -24,6 +30,9 @@ QString NormalizePath(const Settings &settings) {
 	auto result = path.endsWith('/') ? path : (path + '/');
 	if (!folder.exists() && !settings.forceSubPath) {
 		return result;
+	} else if (QFile::exists(FilesManifestPath(result))) {
+		// Continue the export that was made into this folder before.
+		return result;
 	}
 	const auto mode = QDir::AllEntries | QDir::NoDotAndDotDot;
 	const auto list = folder.entryInfoList(mode);
@@ -46,6 +55,10 @@ QString NormalizePath(const Settings &settings) {
 	return result;
 }
 
+QString FilesManifestPath(const QString &folder) {
+	return folder + kFilesManifestName;
+}
+
 std::unique_ptr<AbstractWriter> CreateWriter(Format format) {
 	switch (format) {
 	case Format::Html: return std::make_unique<HtmlWriter>();
@@ -31,6 +31,9 @@ namespace Output {
 
 QString NormalizePath(const Settings &settings);
 
+// Files downloaded into the folder by the previous runs of an export.
+QString FilesManifestPath(const QString &folder);
+
 struct Result;
 class Stats;
 
@@ -15,12 +15,14 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <QtCore/QSize>
 #include <QtCore/QFile>
 #include <QtCore/QDateTime>
+#include <QtCore/QThread>
 
 namespace Export {
 namespace Output {
 namespace {
 
 constexpr auto kMessagesInFile = 1000;
+constexpr auto kMessagesPerRenderThread = 25;
 constexpr auto kPersonalUserpicSize = 90;
 constexpr auto kEntryUserpicSize = 48;
 constexpr auto kServiceMessagePhotoSize = 60;
@@ -346,6 +348,28 @@ QByteArray FormatTimeText(TimeId date) {
 		+ Data::NumberToString(parsed.minute(), 2);
 }
 
+// Calls method(from, till, part) for the parts of [0, count) at once,
+// the first part is processed on the calling thread.
+template <typename Method>
+void ProcessInParallel(int count, int parts, Method &&method) {
+	Expects(parts > 0);
+
+	const auto bound = [&](int part) {
+		return (count * part) / parts;
+	};
+	auto finished = std::vector<crl::semaphore>(parts - 1);
+	for (auto part = 1; part != parts; ++part) {
+		crl::async([&, part] {
+			method(bound(part), bound(part + 1), part);
+			finished[part - 1].release();
+		});
+	}
+	method(0, bound(1), 0);
+	for (auto &semaphore : finished) {
+		semaphore.acquire();
+	}
+}
+
 } // namespace
 
 namespace details {
@@ -552,8 +576,17 @@ public:
 		const QString &basePath,
 		const QByteArray &text,
 		const Data::Photo *photo = nullptr);
-	[[nodiscard]] std::pair<MessageInfo, QByteArray> pushMessage(
+	[[nodiscard]] static QByteArray PrepareServiceText(
 		const Data::Message &message,
+		const Data::DialogInfo &dialog,
+		const PeersMap &peers,
+		Fn<QByteArray(int messageId, QByteArray text)> wrapMessageLink);
+	[[nodiscard]] static MessageInfo PrepareMessageInfo(
+		const Data::Message &message,
+		const QByteArray &serviceText);
+	[[nodiscard]] QByteArray pushMessage(
+		const Data::Message &message,
+		const QByteArray &serviceText,
 		const MessageInfo *previous,
 		const Data::DialogInfo &dialog,
 		const QString &basePath,
@@ -561,6 +594,10 @@ public:
 		const QString &internalLinksDomain,
 		Fn<QByteArray(int messageId, QByteArray text)> wrapMessageLink);
 
+	// Same nesting and paths, but never written, for rendering messages
+	// on other threads while this one holds the real file.
+	[[nodiscard]] std::unique_ptr<Wrap> cloneForRendering() const;
+
 	[[nodiscard]] Result writeBlock(const QByteArray &block);
 
 	[[nodiscard]] Result close();
@@ -571,6 +608,8 @@ public:
 	~Wrap();
 
 private:
+	Wrap(const QByteArray &base, const Context &context);
+
 	[[nodiscard]] QByteArray composeStart();
 	[[nodiscard]] QByteArray pushGenericListEntry(
 		const QString &link,
@@ -620,6 +659,14 @@ private:
 
 };
 
+struct HtmlWriter::PreparedMessage {
+	QByteArray serviceText;
+	MessageInfo info;
+	const MessageInfo *previous = nullptr;
+	int dateMessageId = 0;
+	QByteArray content;
+};
+
 struct HtmlWriter::SavedSection {
 	int priority = 0;
 	QByteArray label;
@@ -685,6 +732,17 @@ HtmlWriter::Wrap::Wrap(
 	_composedStart = composeStart();
 }
 
+HtmlWriter::Wrap::Wrap(const QByteArray &base, const Context &context)
+: _file(QString(), nullptr)
+, _closed(true)
+, _base(base)
+, _context(context) {
+}
+
+auto HtmlWriter::Wrap::cloneForRendering() const -> std::unique_ptr<Wrap> {
+	return std::unique_ptr<Wrap>(new Wrap(_base, _context));
+}
+
 bool HtmlWriter::Wrap::empty() const {
 	return _file.empty();
 }
@@ -1005,36 +1063,13 @@ QByteArray HtmlWriter::Wrap::pushServiceMessage(
 	return result;
 }
 
-auto HtmlWriter::Wrap::pushMessage(
-	const Data::Message &message,
-	const MessageInfo *previous,
-	const Data::DialogInfo &dialog,
-	const QString &basePath,
-	const PeersMap &peers,
-	const QString &internalLinksDomain,
-	Fn<QByteArray(int messageId, QByteArray text)> wrapMessageLink
-) -> std::pair<MessageInfo, QByteArray> {
+QByteArray HtmlWriter::Wrap::PrepareServiceText(
+		const Data::Message &message,
+		const Data::DialogInfo &dialog,
+		const PeersMap &peers,
+		Fn<QByteArray(int messageId, QByteArray text)> wrapMessageLink) {
 	using namespace Data;
 
-	auto info = MessageInfo();
-	info.id = message.id;
-	info.fromId = message.fromId;
-	info.viaBotId = message.viaBotId;
-	info.date = message.date;
-	info.forwardedFromId = message.forwardedFromId;
-	info.forwardedFromName = message.forwardedFromName;
-	info.forwardedDate = message.forwardedDate;
-	info.forwarded = message.forwarded;
-	info.showForwardedAsOriginal = message.showForwardedAsOriginal;
-	if (v::is<UnsupportedMedia>(message.media.content)) {
-		return { info, pushServiceMessage(
-			message.id,
-			dialog,
-			basePath,
-			"This message is not supported by this version "
-			"of 64Gram Desktop. Please update the application.") };
-	}
-
 	const auto wrapReplyToLink = [&](const QByteArray &text) {
 		return wrapMessageLink(message.replyToMsgId, text);
 	};
@@ -1043,7 +1078,7 @@ auto HtmlWriter::Wrap::pushMessage(
 	const auto isChannel = (dialog.type == DialogType::PrivateChannel)
 		|| (dialog.type == DialogType::PublicChannel);
 	const auto serviceFrom = peers.wrapPeerName(message.fromId);
-	const auto serviceText = v::match(message.action.content, [&](
+	return v::match(message.action.content, [&](
 			const ActionChatCreate &data) {
 		return serviceFrom
 			+ " created group &laquo;"
@@ -1275,6 +1310,51 @@ auto HtmlWriter::Wrap::pushMessage(
 			+ wrapReplyToLink("the same background")
 			+ " for this chat";
 	}, [](v::null_t) { return QByteArray(); });
+}
+
+auto HtmlWriter::Wrap::PrepareMessageInfo(
+		const Data::Message &message,
+		const QByteArray &serviceText) -> MessageInfo {
+	auto info = MessageInfo();
+	info.id = message.id;
+	info.fromId = message.fromId;
+	info.viaBotId = message.viaBotId;
+	info.date = message.date;
+	info.forwardedFromId = message.forwardedFromId;
+	info.forwardedFromName = message.forwardedFromName;
+	info.forwardedDate = message.forwardedDate;
+	info.forwarded = message.forwarded;
+	info.showForwardedAsOriginal = message.showForwardedAsOriginal;
+	if (!v::is<Data::UnsupportedMedia>(message.media.content)
+		&& serviceText.isEmpty()) {
+		info.type = MessageInfo::Type::Default;
+	}
+	return info;
+}
+
+QByteArray HtmlWriter::Wrap::pushMessage(
+		const Data::Message &message,
+		const QByteArray &serviceText,
+		const MessageInfo *previous,
+		const Data::DialogInfo &dialog,
+		const QString &basePath,
+		const PeersMap &peers,
+		const QString &internalLinksDomain,
+		Fn<QByteArray(int messageId, QByteArray text)> wrapMessageLink) {
+	using namespace Data;
+
+	if (v::is<UnsupportedMedia>(message.media.content)) {
+		return pushServiceMessage(
+			message.id,
+			dialog,
+			basePath,
+			"This message is not supported by this version "
+			"of 64Gram Desktop. Please update the application.");
+	}
+
+	const auto wrapReplyToLink = [&](const QByteArray &text) {
+		return wrapMessageLink(message.replyToMsgId, text);
+	};
 
 	if (!serviceText.isEmpty()) {
 		const auto &content = message.action.content;
@@ -1283,14 +1363,13 @@ auto HtmlWriter::Wrap::pushMessage(
 			: v::is<ActionSuggestProfilePhoto>(content)
 			? &v::get<ActionSuggestProfilePhoto>(content).photo
 			: nullptr;
-		return { info, pushServiceMessage(
+		return pushServiceMessage(
 			message.id,
 			dialog,
 			basePath,
 			serviceText,
-			photo) };
+			photo);
 	}
-	info.type = MessageInfo::Type::Default;
 
 	const auto wrap = messageNeedsWrap(message, previous);
 	const auto fromPeerId = message.fromId;
@@ -1413,7 +1492,7 @@ auto HtmlWriter::Wrap::pushMessage(
 	block.append(popTag());
 	block.append(popTag());
 
-	return { info, block };
+	return block;
 }
 
 bool HtmlWriter::Wrap::messageNeedsWrap(
@@ -2668,14 +2747,10 @@ Result HtmlWriter::writeDialogSlice(const Data::MessagesSlice &data) {
 	Expects(_chat != nullptr);
 	Expects(!data.list.empty());
 
-	const auto messageLinkWrapper = [&](int messageId, QByteArray text) {
-		return wrapMessageLink(messageId, text);
-	};
 	auto oldIndex = (_messagesCount > 0)
 		? ((_messagesCount - 1) / kMessagesInFile)
 		: 0;
-	auto previous = _lastMessageInfo.get();
-	auto saved = std::optional<MessageInfo>();
+	auto messages = std::vector<not_null<const Data::Message*>>();
 	auto block = QByteArray();
 	for (const auto &message : data.list) {
 		if (Data::SkipMessageByDate(message, _settings)) {
@@ -2683,17 +2758,14 @@ Result HtmlWriter::writeDialogSlice(const Data::MessagesSlice &data) {
 		}
 		const auto newIndex = (_messagesCount / kMessagesInFile);
 		if (oldIndex != newIndex) {
+			block.append(renderMessages(base::take(messages), data));
 			if (const auto result = _chat->writeBlock(block); !result) {
 				return result;
 			} else if (const auto next = switchToNextChatFile(newIndex)) {
-				Assert(saved.has_value() || _lastMessageInfo != nullptr);
-				_lastMessageIdsPerFile.push_back(saved
-					? saved->id
-					: _lastMessageInfo->id);
+				Assert(_lastMessageInfo != nullptr);
+				_lastMessageIdsPerFile.push_back(_lastMessageInfo->id);
 				block = QByteArray();
 				_lastMessageInfo = nullptr;
-				previous = nullptr;
-				saved = std::nullopt;
 				oldIndex = newIndex;
 			} else {
 				return next;
@@ -2705,32 +2777,95 @@ Result HtmlWriter::writeDialogSlice(const Data::MessagesSlice &data) {
 			}
 			_chatFileEmpty = false;
 		}
-		const auto date = message.date;
+		messages.push_back(&message);
+		++_messagesCount;
+	}
+	block.append(renderMessages(messages, data));
+	return block.isEmpty() ? Result::Success() : _chat->writeBlock(block);
+}
+
+QByteArray HtmlWriter::renderMessages(
+		const std::vector<not_null<const Data::Message*>> &list,
+		const Data::MessagesSlice &data) {
+	Expects(_chat != nullptr);
+
+	if (list.empty()) {
+		return QByteArray();
+	}
+	const auto messageLinkWrapper = [&](int messageId, QByteArray text) {
+		return wrapMessageLink(messageId, text);
+	};
+	const auto count = int(list.size());
+	const auto parts = std::clamp(
+		count / kMessagesPerRenderThread,
+		1,
+		std::max(QThread::idealThreadCount(), 1));
+
+	// Only the joining of messages depends on the previous one, so first
+	// we find out which messages are service ones and then render them.
+	auto prepared = std::vector<PreparedMessage>(count);
+	ProcessInParallel(count, parts, [&](int from, int till, int part) {
+		for (auto i = from; i != till; ++i) {
+			auto &entry = prepared[i];
+			entry.serviceText = Wrap::PrepareServiceText(
+				*list[i],
+				_dialog,
+				data.peers,
+				messageLinkWrapper);
+			entry.info = Wrap::PrepareMessageInfo(
+				*list[i],
+				entry.serviceText);
+		}
+	});
+	auto previous = _lastMessageInfo.get();
+	for (auto &entry : prepared) {
+		const auto date = entry.info.date;
 		if (DisplayDate(date, previous ? previous->date : 0)) {
-			block.append(_chat->pushServiceMessage(
-				--_dateMessageId,
+			entry.dateMessageId = --_dateMessageId;
+		}
+		entry.previous = previous;
+		previous = &entry.info;
+	}
+
+	auto wraps = std::vector<std::unique_ptr<Wrap>>();
+	for (auto part = 1; part != parts; ++part) {
+		wraps.push_back(_chat->cloneForRendering());
+	}
+	ProcessInParallel(count, parts, [&](int from, int till, int part) {
+		const auto wrap = part ? wraps[part - 1].get() : _chat.get();
+		for (auto i = from; i != till; ++i) {
+			auto &entry = prepared[i];
+			const auto &message = *list[i];
+			if (entry.dateMessageId) {
+				entry.content.append(wrap->pushServiceMessage(
+					entry.dateMessageId,
+					_dialog,
+					_settings.path,
+					FormatDateText(message.date)));
+			}
+			entry.content.append(wrap->pushMessage(
+				message,
+				entry.serviceText,
+				entry.previous,
 				_dialog,
 				_settings.path,
-				FormatDateText(date)));
+				data.peers,
+				_environment.internalLinksDomain,
+				messageLinkWrapper));
 		}
-		const auto [info, content] = _chat->pushMessage(
-			message,
-			previous,
-			_dialog,
-			_settings.path,
-			data.peers,
-			_environment.internalLinksDomain,
-			messageLinkWrapper);
-		block.append(content);
+	});
+	_lastMessageInfo = std::make_unique<MessageInfo>(prepared.back().info);
 
-		++_messagesCount;
-		saved = info;
-		previous = &*saved;
+	auto size = 0;
+	for (const auto &entry : prepared) {
+		size += entry.content.size();
 	}
-	if (saved) {
-		_lastMessageInfo = std::make_unique<MessageInfo>(*saved);
+	auto result = QByteArray();
+	result.reserve(size);
+	for (const auto &entry : prepared) {
+		result.append(entry.content);
 	}
-	return block.isEmpty() ? Result::Success() : _chat->writeBlock(block);
+	return result;
 }
 
 Result HtmlWriter::writeEmptySinglePeer() {
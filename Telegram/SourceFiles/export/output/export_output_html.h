@@ -88,6 +88,7 @@ private:
 	using MediaData = details::MediaData;
 	class Wrap;
 	struct MessageInfo;
+	struct PreparedMessage;
 	enum class DialogsMode {
 		None,
 		Chats,
@@ -113,6 +114,9 @@ private:
 	[[nodiscard]] Result validateDialogsMode(bool isLeftChannel);
 	[[nodiscard]] Result writeDialogOpening(int index);
 	[[nodiscard]] Result switchToNextChatFile(int index);
+	[[nodiscard]] QByteArray renderMessages(
+		const std::vector<not_null<const Data::Message*>> &list,
+		const Data::MessagesSlice &data);
 	[[nodiscard]] Result writeEmptySinglePeer();
 
 	void pushSection(
@@ -23,16 +23,31 @@ namespace {
 
 using Context = details::JsonContext;
 
+[[nodiscard]] bool NeedsEscaping(char ch) {
+	return (ch >= 0 && ch < 32)
+		|| (ch == '"')
+		|| (ch == '\\')
+		|| (ch == char(0xE2)); // Possible line or paragraph separator.
+}
+
 QByteArray SerializeString(const QByteArray &value) {
 	const auto size = value.size();
 	const auto begin = value.data();
 	const auto end = begin + size;
 
 	auto result = QByteArray();
-	result.reserve(2 + size * 4);
+	result.reserve(2 + size + size / 8);
 	result.append('"');
+	auto from = begin;
 	for (auto p = begin; p != end; ++p) {
 		const auto ch = *p;
+		if (!NeedsEscaping(ch)) {
+			continue;
+		}
+
+		// Most of the texts don't need escaping, copy them in one piece.
+		result.append(from, p - from);
+		from = p + 1;
 		if (ch == '\n') {
 			result.append("\\n", 2);
 		} else if (ch == '\r') {
@@ -59,12 +74,13 @@ QByteArray SerializeString(const QByteArray &value) {
 			} else if (*(p + 2) == char(0xA9)) { // Paragraph separator.
 				result.append("\\u2029", 6);
 			} else {
-				result.append(ch);
+				from = p;
 			}
 		} else {
-			result.append(ch);
+			from = p;
 		}
 	}
+	result.append(from, end - from);
 	result.append('"');
 	return result;
 }
@@ -103,8 +119,14 @@ QByteArray SerializeObject(
 	const auto guard = gsl::finally([&] { context.nesting.pop_back(); });
 	const auto next = '\n' + Indentation(context);
 
+	auto size = 2 + indent.size();
+	for (const auto &[key, value] : values) {
+		size += next.size() + key.size() + value.size() + 5;
+	}
+
 	auto first = true;
 	auto result = QByteArray();
+	result.reserve(size);
 	result.append('{');
 	for (const auto &[key, value] : values) {
 		if (value.isEmpty()) {
@@ -128,8 +150,14 @@ QByteArray SerializeArray(
 	const auto indent = Indentation(context.nesting.size());
 	const auto next = '\n' + Indentation(context.nesting.size() + 1);
 
+	auto size = 3 + indent.size();
+	for (const auto &value : values) {
+		size += next.size() + value.size() + 1;
+	}
+
 	auto first = true;
 	auto result = QByteArray();
+	result.reserve(size);
 	result.append('[');
 	for (const auto &value : values) {
 		if (first) {
@@ -3071,6 +3071,9 @@ void History::resizeToWidth(int newWidth) {
 		return;
 	}
 	_flags &= ~(Flag::HasPendingResizedItems | Flag::PendingAllItemsResize);
+	if (request != Request::ResizePending) {
+		_flags &= ~Flag::HasDeferredResizedItems;
+	}
 
 	_width = newWidth;
 	int y = 0;
@@ -3081,6 +3084,121 @@ void History::resizeToWidth(int newWidth) {
 	_height = y;
 }
 
+void History::resizeToWidthAround(int newWidth, int from, int till) {
+	using Request = HistoryBlock::ResizeRequest;
+	if (!(_flags & Flag::PendingAllItemsResize) && _width == newWidth) {
+		resizeToWidth(newWidth);
+		return;
+	}
+	const auto request = (_flags & Flag::PendingAllItemsResize)
+		? Request::ReinitAll
+		: Request::ResizeAll;
+	_flags &= ~(Flag::HasPendingResizedItems
+		| Flag::PendingAllItemsResize
+		| Flag::HasDeferredResizedItems);
+
+	_width = newWidth;
+	auto y = 0;
+	for (const auto &block : blocks) {
+		const auto top = block->y();
+		block->setY(y);
+		y += block->resizeGetHeightAround(
+			newWidth,
+			request,
+			from - top,
+			till - top);
+	}
+	_height = y;
+}
+
+bool History::resizeDeferred(int from, int till, crl::time deadline) {
+	if (!hasDeferredResizedItems()) {
+		return false;
+	}
+	_flags &= ~Flag::HasDeferredResizedItems;
+
+	auto laidOut = false;
+	auto y = 0;
+	for (const auto &block : blocks) {
+		const auto top = block->y();
+		block->setY(y);
+		y += block->resizeDeferredGetHeight(
+			_width,
+			from - top,
+			till - top,
+			deadline,
+			laidOut);
+	}
+	_height = y;
+	return laidOut;
+}
+
+bool History::hasDeferredResizedItems() const {
+	return _flags & Flag::HasDeferredResizedItems;
+}
+
+bool History::unloadBlocksOutside(int from, int till) {
+	if (isBuildingFrontBlock() || blocks.size() < 2) {
+		return false;
+	}
+	const auto keep = [&](not_null<HistoryBlock*> block) {
+		for (const auto &message : block->messages) {
+			const auto view = message.get();
+			const auto item = view->data();
+			if (view == scrollTopItem
+				|| view == _unreadBarView
+				|| view == _firstUnreadView
+				|| item == _joinedMessage
+				|| !item->isRegular()) {
+				return true;
+			}
+		}
+		return false;
+	};
+	const auto unload = [&](not_null<HistoryBlock*> block) {
+		// Views remove themselves from their items when destroyed.
+		base::take(block->messages);
+		removeBlock(block);
+	};
+	auto unloadedTop = false;
+	while (blocks.size() > 1) {
+		const auto block = blocks.front().get();
+		if (block->y() + block->height() >= from || keep(block)) {
+			break;
+		}
+		unload(block);
+		unloadedTop = true;
+	}
+	auto unloadedBottom = false;
+	while (blocks.size() > 1) {
+		const auto block = blocks.back().get();
+		if (block->y() <= till || keep(block)) {
+			break;
+		}
+		unload(block);
+		unloadedBottom = true;
+	}
+	if (unloadedTop) {
+		_loadedAtTop = false;
+	}
+	if (unloadedBottom) {
+		_loadedAtBottom = false;
+	}
+	if (!unloadedTop && !unloadedBottom) {
+		return false;
+	}
+	owner().notifyHistoryChangeDelayed(this);
+	return true;
+}
+
+int History::loadedViewsCount() const {
+	auto result = 0;
+	for (const auto &block : blocks) {
+		result += int(block->messages.size());
+	}
+	return result;
+}
+
 void History::forceFullResize() {
 	_width = 0;
 	_flags |= Flag::HasPendingResizedItems;
@@ -3593,7 +3711,7 @@ int HistoryBlock::resizeGetHeight(int newWidth, ResizeRequest request) {
 	} else {
 		for (const auto &message : messages) {
 			message->setY(y);
-			y += message->pendingResize()
+			y += (message->pendingResize() && !message->deferredResize())
 				? message->resizeGetHeight(newWidth)
 				: message->height();
 		}
@@ -3602,6 +3720,60 @@ int HistoryBlock::resizeGetHeight(int newWidth, ResizeRequest request) {
 	return _height;
 }
 
+int HistoryBlock::resizeGetHeightAround(
+		int newWidth,
+		ResizeRequest request,
+		int from,
+		int till) {
+	Expects(request != ResizeRequest::ResizePending);
+
+	auto y = 0;
+	for (const auto &message : messages) {
+		const auto top = message->y();
+		message->setY(y);
+
+		// Elements that were never laid out have no height to keep.
+		if (message->width() > 0
+			&& (top > till || top + message->height() < from)) {
+			message->deferResize(request == ResizeRequest::ReinitAll);
+			_history->_flags |= History::Flag::HasDeferredResizedItems;
+			y += message->height();
+			continue;
+		} else if (request == ResizeRequest::ReinitAll) {
+			message->initDimensions();
+		}
+		y += message->resizeGetHeight(newWidth);
+	}
+	_height = y;
+	return _height;
+}
+
+int HistoryBlock::resizeDeferredGetHeight(
+		int newWidth,
+		int from,
+		int till,
+		crl::time deadline,
+		bool &laidOut) {
+	auto y = 0;
+	for (const auto &message : messages) {
+		const auto top = message->y();
+		message->setY(y);
+		if (message->deferredResize()) {
+			if (top <= till
+				&& top + message->height() >= from
+				&& crl::now() < deadline) {
+				y += message->resizeGetHeight(newWidth);
+				laidOut = true;
+				continue;
+			}
+			_history->_flags |= History::Flag::HasDeferredResizedItems;
+		}
+		y += message->height();
+	}
+	_height = y;
+	return _height;
+}
+
 void HistoryBlock::remove(not_null<Element*> view) {
 	Expects(view->block() == this);
 
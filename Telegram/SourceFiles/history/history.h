@@ -298,6 +298,21 @@ public:
 
 	void resizeToWidth(int newWidth);
 	void forceFullResize();
+
+	// Lays out only the elements intersecting [from, till] of the current
+	// layout, the others keep their heights until resizeDeferred().
+	void resizeToWidthAround(int newWidth, int from, int till);
+
+	// Returns true if some of the deferred elements were laid out.
+	bool resizeDeferred(int from, int till, crl::time deadline);
+	[[nodiscard]] bool hasDeferredResizedItems() const;
+
+	// Destroys the views of the whole blocks lying outside [from, till],
+	// the history is marked as not loaded at that side, so the messages
+	// are requested again when scrolled back to. The blocks with the
+	// scroll top, the unread bar or local messages are always kept.
+	bool unloadBlocksOutside(int from, int till);
+	[[nodiscard]] int loadedViewsCount() const;
 	int height() const;
 
 	void itemRemoved(not_null<HistoryItem*> item);
@@ -471,6 +486,7 @@ private:
 		FakeUnreadWhileOpened = (1 << 4),
 		HasPinnedMessages = (1 << 5),
 		ResolveChatListMessage = (1 << 6),
+		HasDeferredResizedItems = (1 << 7),
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) {
@@ -668,6 +684,17 @@ public:
 	void refreshView(not_null<Element*> view);
 
 	int resizeGetHeight(int newWidth, ResizeRequest request);
+	int resizeGetHeightAround(
+		int newWidth,
+		ResizeRequest request,
+		int from,
+		int till);
+	int resizeDeferredGetHeight(
+		int newWidth,
+		int from,
+		int till,
+		crl::time deadline,
+		bool &laidOut);
 	int y() const {
 		return _y;
 	}
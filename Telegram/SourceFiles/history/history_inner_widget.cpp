@@ -110,6 +110,18 @@ namespace {
 constexpr auto kScrollDateHideTimeout = 1000;
 constexpr auto kUnloadHeavyPartsPages = 2;
 constexpr auto kClearUserpicsAfter = 50;
+constexpr auto kResizeAroundPages = 1;
+constexpr auto kResizeDeferredSlice = crl::time(4);
+constexpr auto kResizeDeferredMaxPagesShift = 20;
+constexpr auto kResizeDeferredRetryDelay = crl::time(100);
+
+// An open chat keeps the views of about kMaxLoadedViews messages, or of
+// as many as needed to fill 2 * kKeepLoadedPages + 1 screens, if that
+// is more. The heavy media parts are unloaded kUnloadHeavyPartsPages
+// away already, so what is bounded here is the text layouts and the
+// media objects of the views themselves.
+constexpr auto kMaxLoadedViews = 1000;
+constexpr auto kKeepLoadedPages = 8;
 
 // Helper binary search for an item in a list that is not completely
 // above the given top of the visible area or below the given bottom of the visible area
@@ -447,7 +459,8 @@ HistoryInner::HistoryInner(
 , _touchSelectTimer([=] { onTouchSelect(); })
 , _touchScrollTimer([=] { onTouchScrollTimer(); })
 , _scrollDateCheck([this] { scrollDateCheck(); })
-, _scrollDateHideTimer([this] { scrollDateHideByTimer(); }) {
+, _scrollDateHideTimer([this] { scrollDateHideByTimer(); })
+, _resizeDeferredTimer([=] { resizeDeferredItems(); }) {
 	_history->delegateMixin()->setCurrent(this);
 	if (_migrated) {
 		_migrated->delegateMixin()->setCurrent(this);
@@ -3216,6 +3229,9 @@ void HistoryInner::checkActivation() {
 }
 
 void HistoryInner::recountHistoryGeometry() {
+	if (_contentWidth != _scroll->width()) {
+		_resizeDeferredPages = 0;
+	}
 	_contentWidth = _scroll->width();
 
 	if (_history->hasPendingResizedItems()
@@ -3231,9 +3247,30 @@ void HistoryInner::recountHistoryGeometry() {
 		accumulate_max(oldHistoryPaddingTop, _botAbout->height);
 	}
 
-	_history->resizeToWidth(_contentWidth);
+	// Lay out the elements around the visible area right now,
+	// the others keep their heights until resizeDeferredItems().
+	const auto aroundFrom = _visibleAreaTop
+		- kResizeAroundPages * visibleHeight;
+	const auto aroundTill = _visibleAreaBottom
+		+ kResizeAroundPages * visibleHeight;
+	const auto resizeAround = [&](not_null<History*> history, int top) {
+		if (top < 0) {
+			history->resizeToWidth(_contentWidth);
+		} else {
+			history->resizeToWidthAround(
+				_contentWidth,
+				aroundFrom - top,
+				aroundTill - top);
+		}
+	};
+	const auto htop = historyTop();
+	const auto mtop = migratedTop();
+	resizeAround(_history, htop);
 	if (_migrated) {
-		_migrated->resizeToWidth(_contentWidth);
+		resizeAround(_migrated, mtop);
+	}
+	if (hasDeferredResizedItems() && !_resizeDeferredTimer.isActive()) {
+		_resizeDeferredTimer.callOnce(0);
 	}
 
 	// With migrated history we perhaps do not need to display
@@ -3281,6 +3318,74 @@ void HistoryInner::recountHistoryGeometry() {
 	}
 }
 
+void HistoryInner::resizeDeferredItems() {
+	if (!hasDeferredResizedItems()) {
+		_resizeDeferredPages = 0;
+		return;
+	} else if (hasPendingResizedItems()) {
+		_widget->handlePendingHistoryUpdate();
+		if (hasPendingResizedItems()) {
+			// The geometry can't be updated while the section is animating.
+			_resizeDeferredTimer.callOnce(kResizeDeferredRetryDelay);
+			return;
+		}
+	}
+	const auto visibleHeight = std::max(
+		_visibleAreaBottom - _visibleAreaTop,
+		1);
+	const auto margin = int(std::min(
+		int64(visibleHeight) << _resizeDeferredPages,
+		int64(height())));
+	const auto from = _visibleAreaTop - margin;
+	const auto till = _visibleAreaBottom + margin;
+	const auto deadline = crl::now() + kResizeDeferredSlice;
+	auto laidOut = false;
+	const auto resize = [&](not_null<History*> history, int top) {
+		if (top >= 0
+			&& history->resizeDeferred(from - top, till - top, deadline)) {
+			history->setHasPendingResizedItems();
+			laidOut = true;
+		}
+	};
+	const auto htop = historyTop();
+	const auto mtop = migratedTop();
+	resize(_history, htop);
+	if (_migrated) {
+		resize(_migrated, mtop);
+	}
+	if (laidOut) {
+		_widget->handlePendingHistoryUpdate();
+	}
+
+	// Grow the window only when everything inside it was laid out.
+	if (crl::now() < deadline
+		&& _resizeDeferredPages < kResizeDeferredMaxPagesShift) {
+		++_resizeDeferredPages;
+	}
+	if (hasDeferredResizedItems()) {
+		_resizeDeferredTimer.callOnce(0);
+	} else {
+		_resizeDeferredPages = 0;
+	}
+}
+
+bool HistoryInner::unloadFarBlocks() {
+	if (_migrated
+		|| hasPendingResizedItems()
+		|| _history->loadedViewsCount() <= kMaxLoadedViews) {
+		return false;
+	}
+	const auto htop = historyTop();
+	if (htop < 0) {
+		return false;
+	}
+	const auto keep = kKeepLoadedPages
+		* (_visibleAreaBottom - _visibleAreaTop);
+	return _history->unloadBlocksOutside(
+		_visibleAreaTop - keep - htop,
+		_visibleAreaBottom + keep - htop);
+}
+
 void HistoryInner::updateBotInfo(bool recount) {
 	if (!_botAbout) {
 		return;
@@ -3307,6 +3412,30 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	// if history has pending resize events we should not update scrollTopItem
 	if (hasPendingResizedItems()) {
 		return;
+	} else if (hasDeferredResizedItems()) {
+		// Elements scrolled into view are laid out before being painted.
+		auto laidOut = false;
+		const auto resize = [&](not_null<History*> history, int htop) {
+			if (htop >= 0
+				&& history->resizeDeferred(
+					top - htop,
+					bottom - htop,
+					std::numeric_limits<crl::time>::max())) {
+				history->setHasPendingResizedItems();
+				laidOut = true;
+			}
+		};
+		const auto htop = historyTop();
+		const auto mtop = migratedTop();
+		resize(_history, htop);
+		if (_migrated) {
+			resize(_migrated, mtop);
+		}
+		if (laidOut) {
+			// This restores the scroll and calls us again.
+			_widget->handlePendingHistoryUpdate();
+			return;
+		}
 	}
 
 	if (bottom >= _historyPaddingTop + historyHeight() + st::historyPaddingBottom) {
@@ -4429,6 +4558,11 @@ bool HistoryInner::hasPendingResizedItems() const {
 		|| (_migrated && _migrated->hasPendingResizedItems());
 }
 
+bool HistoryInner::hasDeferredResizedItems() const {
+	return _history->hasDeferredResizedItems()
+		|| (_migrated && _migrated->hasDeferredResizedItems());
+}
+
 void HistoryInner::deleteAsGroup(FullMsgId itemId) {
 	if (const auto item = session().data().message(itemId)) {
 		const auto group = session().data().groups().find(item);
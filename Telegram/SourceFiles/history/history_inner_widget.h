@@ -119,6 +119,10 @@ public:
 	void changeItemsRevealHeight(int revealHeight);
 	void checkActivation();
 	void recountHistoryGeometry();
+
+	// Returns true if some blocks were unloaded and the history
+	// geometry should be updated.
+	bool unloadFarBlocks();
 	void updateSize();
 	void setShownPinned(HistoryItem *item);
 
@@ -300,6 +304,7 @@ private:
 
 	void scrollDateCheck();
 	void scrollDateHideByTimer();
+	void resizeDeferredItems();
 	bool canHaveFromUserpics() const;
 	void mouseActionStart(const QPoint &screenPos, Qt::MouseButton button);
 	void mouseActionUpdate();
@@ -431,6 +436,7 @@ private:
 
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const;
+	bool hasDeferredResizedItems() const;
 
 	const not_null<HistoryWidget*> _widget;
 	const not_null<Ui::ScrollArea*> _scroll;
@@ -535,4 +541,9 @@ private:
 	int _scrollDateLastItemTop = 0;
 	ClickHandlerPtr _scrollDateLink;
 
+	// Far elements are laid out for the new width in slices,
+	// the window around the visible area grows with each slice.
+	base::Timer _resizeDeferredTimer;
+	int _resizeDeferredPages = 0;
+
 };
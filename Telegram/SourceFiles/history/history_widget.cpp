@@ -118,6 +118,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_account.h"
 #include "storage/file_upload.h"
 #include "storage/storage_media_prepare.h"
+#include "storage/storage_history_cache.h"
 #include "media/audio/media_audio.h"
 #include "media/audio/media_audio_capture.h"
 #include "media/player/media_player_instance.h"
@@ -3325,6 +3326,55 @@ void HistoryWidget::messagesReceived(
 	}
 }
 
+bool HistoryWidget::firstLoadFromCache() {
+	Expects(_history != nullptr);
+
+	auto cached = session().data().historyCache().take(_peer->id);
+	if (!cached) {
+		return false;
+	}
+
+	const auto count = cached->match([](
+			const MTPDmessages_messagesNotModified &) {
+		return 0;
+	}, [](const auto &data) {
+		return int(data.vmessages().v.size());
+	});
+
+	// Messages newer than the cached slice are requested after it is shown.
+	_history->setNotLoadedAtBottom();
+	_firstLoadRequest = -1; // hack - handle as the first load result
+	messagesReceived(_peer, *cached, _firstLoadRequest);
+	validateCachedSlice(_history, count);
+	return true;
+}
+
+void HistoryWidget::validateCachedSlice(
+		not_null<History*> history,
+		int count) {
+	// The slice could be stored days ago, messages in it could be edited
+	// or deleted while we were offline, so the same range is requested.
+	const auto type = Data::Histories::RequestType::History;
+	auto &histories = history->owner().histories();
+	histories.sendRequest(history, type, [=](Fn<void()> finish) {
+		return history->session().api().request(MTPmessages_GetHistory(
+			history->peer->input,
+			MTP_int(0), // offset_id
+			MTP_int(0), // offset_date
+			MTP_int(0), // add_offset
+			MTP_int(count),
+			MTP_int(0), // max_id
+			MTP_int(0), // min_id
+			MTP_long(0) // hash
+		)).done([=](const MTPmessages_Messages &result) {
+			history->owner().historyCache().validate(history, result);
+			finish();
+		}).fail([=] {
+			finish();
+		}).send();
+	});
+}
+
 void HistoryWidget::historyLoaded() {
 	_historyInited = false;
 	doneShow();
@@ -3399,6 +3449,11 @@ void HistoryWidget::firstLoadMessages() {
 	const auto minId = 0;
 	const auto historyHash = uint64(0);
 
+	const auto newest = !offsetId && !offset && (from == _history);
+	if (newest && !_migrated && firstLoadFromCache()) {
+		return;
+	}
+
 	const auto history = from;
 	const auto type = Data::Histories::RequestType::History;
 	auto &histories = history->owner().histories();
@@ -3413,6 +3468,9 @@ void HistoryWidget::firstLoadMessages() {
 			MTP_int(minId),
 			MTP_long(historyHash)
 		)).done([=](const MTPmessages_Messages &result) {
+			if (newest) {
+				history->owner().historyCache().store(history, result);
+			}
 			messagesReceived(history->peer, result, _firstLoadRequest);
 			finish();
 		}).fail([=](const MTP::Error &error) {
@@ -3531,6 +3589,7 @@ void HistoryWidget::loadMessagesDown() {
 			MTP_long(historyHash)
 		)).done([=](const MTPmessages_Messages &result) {
 			messagesReceived(history->peer, result, _preloadDownRequest);
+			history->owner().historyCache().storeNewer(history, result);
 			finish();
 		}).fail([=](const MTP::Error &error) {
 			messagesFailed(error, _preloadDownRequest);
@@ -3654,6 +3713,22 @@ void HistoryWidget::visibleAreaUpdated() {
 		_list->visibleAreaUpdated(scrollTop, scrollBottom);
 		controller()->floatPlayerAreaUpdated();
 		session().data().itemVisibilitiesUpdated();
+		unloadFarHistory();
+	}
+}
+
+void HistoryWidget::unloadFarHistory() {
+	// Don't change the edges of the loaded history under the requests,
+	// the results are added right next to the loaded messages.
+	if (_firstLoadRequest
+		|| _delayedShowAtRequest
+		|| _preloadRequest
+		|| _preloadDownRequest
+		|| _scrollToAnimation.animating()
+		|| !_historyInited) {
+		return;
+	} else if (_list->unloadFarBlocks()) {
+		handlePendingHistoryUpdate();
 	}
 }
 
@@ -157,6 +157,7 @@ public:
 	static bool switchPinnedHidden(not_null<PeerData*> peer, bool hidden);
 	void updateControlsVisibility();
 	void updateControlsGeometry();
+	void handlePendingHistoryUpdate();
 
 	History *history() const;
 	PeerData *peer() const;
@@ -388,7 +389,6 @@ private:
 	void sendScheduled();
 	void sendWhenOnline();
 	[[nodiscard]] SendMenu::Type sendButtonMenuType() const;
-	void handlePendingHistoryUpdate();
 	void fullInfoUpdated();
 	void toggleTabbedSelectorMode();
 	void recountChatWidth();
@@ -549,6 +549,8 @@ private:
 	void requestPreview();
 	void gotPreview(QString links, const MTPMessageMedia &media, mtpRequestId req);
 	void messagesReceived(not_null<PeerData*> peer, const MTPmessages_Messages &messages, int requestId);
+	bool firstLoadFromCache();
+	void validateCachedSlice(not_null<History*> history, int count);
 	void messagesFailed(const MTP::Error &error, int requestId);
 	void addMessagesToFront(not_null<PeerData*> peer, const QVector<MTPMessage> &messages);
 	void addMessagesToBack(not_null<PeerData*> peer, const QVector<MTPMessage> &messages);
@@ -603,6 +605,7 @@ private:
 	int countInitialScrollTop();
 	int countAutomaticScrollTop();
 	void preloadHistoryByScroll();
+	void unloadFarHistory();
 	void checkReplyReturns();
 	void scrollToAnimationCallback(FullMsgId attachToId, int relativeTo);
 
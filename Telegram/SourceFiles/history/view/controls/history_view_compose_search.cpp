@@ -746,6 +746,12 @@ ComposeSearch::Inner::Inner(
 		}
 	}, _topBar->lifetime());
 
+	_apiSearch.localFounds(
+	) | rpl::start_with_next([=] {
+		// Don't jump to the first result until the server answers.
+		_list.controller->addItems(_apiSearch.messages().messages, true);
+	}, _topBar->lifetime());
+
 	_apiSearch.newFounds(
 	) | rpl::start_with_next([=] {
 		const auto &apiData = _apiSearch.messages();
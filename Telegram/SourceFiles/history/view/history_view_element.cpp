@@ -566,6 +566,16 @@ bool Element::pendingResize() const {
 	return _flags & Flag::NeedsResize;
 }
 
+void Element::deferResize(bool reinit) {
+	_flags |= reinit
+		? (Flag::DeferredResize | Flag::NeedsResize)
+		: Flag::DeferredResize;
+}
+
+bool Element::deferredResize() const {
+	return _flags & Flag::DeferredResize;
+}
+
 bool Element::isAttachedToPrevious() const {
 	return _flags & Flag::AttachedToPrevious;
 }
@@ -1130,6 +1140,7 @@ QSize Element::countOptimalSize() {
 }
 
 QSize Element::countCurrentSize(int newWidth) {
+	_flags &= ~Flag::DeferredResize;
 	if (_flags & Flag::NeedsResize) {
 		initDimensions();
 	}
@@ -264,6 +264,7 @@ public:
 		CustomEmojiRepainting = 0x0100,
 		ScheduledUntilOnline = 0x0200,
 		TopicRootReply = 0x0400,
+		DeferredResize = 0x0800,
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) { return true; }
@@ -291,6 +292,11 @@ public:
 
 	void setPendingResize();
 	[[nodiscard]] bool pendingResize() const;
+
+	// Keeps the size for the previous width until the next resize,
+	// used to lay out the elements far from the visible area later.
+	void deferResize(bool reinit);
+	[[nodiscard]] bool deferredResize() const;
 	[[nodiscard]] bool isUnderCursor() const;
 
 	[[nodiscard]] bool isLastAndSelfMessage() const;
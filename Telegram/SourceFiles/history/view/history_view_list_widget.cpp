@@ -83,6 +83,9 @@ constexpr auto kPreloadIfLessThanScreens = 2;
 constexpr auto kPreloadedScreensCountFull
 	= kPreloadedScreensCount + 1 + kPreloadedScreensCount;
 constexpr auto kClearUserpicsAfter = 50;
+constexpr auto kResizeAroundPages = 1;
+constexpr auto kResizeDeferredSlice = crl::time(4);
+constexpr auto kResizeDeferredMaxPagesShift = 20;
 
 [[nodiscard]] std::unique_ptr<TranslateTracker> MaybeTranslateTracker(
 		History *history) {
@@ -316,6 +319,7 @@ ListWidget::ListWidget(
 	setAttribute(Qt::WA_AcceptTouchEvents);
 	setMouseTracking(true);
 	_scrollDateHideTimer.setCallback([this] { scrollDateHideByTimer(); });
+	_resizeDeferredTimer.setCallback([=] { resizeDeferredItemsByTimer(); });
 	session().data().viewRepaintRequest(
 	) | rpl::start_with_next([this](auto view) {
 		if (view->delegate() == this) {
@@ -997,6 +1001,16 @@ void ListWidget::visibleTopBottomUpdated(
 		checkUnreadBarCreation();
 	}
 	updateVisibleTopItem();
+
+	// Elements scrolled into view are laid out before being painted.
+	if (_resizeDeferredTimer.isActive()
+		&& resizeDeferredItems(
+			_visibleTop,
+			_visibleBottom,
+			std::numeric_limits<crl::time>::max())) {
+		updateSize();
+	}
+
 	if (scrolledUp) {
 		_scrollDateCheck.call();
 	} else {
@@ -1912,15 +1926,43 @@ int ListWidget::resizeGetHeight(int newWidth) {
 	update();
 
 	const auto resizeAllItems = (_itemsWidth != newWidth);
+	if (resizeAllItems) {
+		_resizeDeferredPages = 0;
+	}
+
+	// Lay out the elements around the visible area right now,
+	// the others keep their heights until resizeDeferredItems().
+	const auto visibleHeight = _visibleBottom - _visibleTop;
+	const auto aroundFrom = _visibleTop
+		- _itemsTop
+		- kResizeAroundPages * visibleHeight;
+	const auto aroundTill = _visibleBottom
+		- _itemsTop
+		+ kResizeAroundPages * visibleHeight;
+	const auto deferAround = resizeAllItems && (visibleHeight > 0);
+	auto deferred = false;
 	auto newHeight = 0;
 	for (const auto &view : _items) {
+		const auto top = view->y();
 		view->setY(newHeight);
-		if (view->pendingResize() || resizeAllItems) {
+		const auto outside = deferAround
+			&& view->width() > 0
+			&& (top > aroundTill || top + view->height() < aroundFrom);
+		if (outside) {
+			view->deferResize(false);
+		}
+		if (view->deferredResize() && (outside || !resizeAllItems)) {
+			deferred = true;
+			newHeight += view->height();
+		} else if (view->pendingResize() || resizeAllItems) {
 			newHeight += view->resizeGetHeight(newWidth);
 		} else {
 			newHeight += view->height();
 		}
 	}
+	if (deferred && !_resizeDeferredTimer.isActive()) {
+		_resizeDeferredTimer.callOnce(0);
+	}
 	if (newHeight > 0) {
 		_itemAverageHeight = std::max(
 			itemMinimalHeight(),
@@ -1935,6 +1977,54 @@ int ListWidget::resizeGetHeight(int newWidth) {
 	return _itemsTop + _itemsHeight + st::historyPaddingBottom;
 }
 
+bool ListWidget::resizeDeferredItems(
+		int from,
+		int till,
+		crl::time deadline) {
+	auto laidOut = false;
+	for (const auto &view : _items) {
+		if (!view->deferredResize()) {
+			continue;
+		}
+		const auto top = itemTop(view);
+		if (top <= till
+			&& top + view->height() >= from
+			&& crl::now() < deadline) {
+			view->resizeGetHeight(_itemsWidth);
+			laidOut = true;
+		}
+	}
+	return laidOut;
+}
+
+void ListWidget::resizeDeferredItemsByTimer() {
+	const auto visibleHeight = std::max(_visibleBottom - _visibleTop, 1);
+	const auto margin = int(std::min(
+		int64(visibleHeight) << _resizeDeferredPages,
+		int64(height())));
+	const auto deadline = crl::now() + kResizeDeferredSlice;
+	if (resizeDeferredItems(
+			_visibleTop - margin,
+			_visibleBottom + margin,
+			deadline)) {
+		updateSize();
+	}
+
+	// Grow the window only when everything inside it was laid out.
+	if (crl::now() < deadline
+		&& _resizeDeferredPages < kResizeDeferredMaxPagesShift) {
+		++_resizeDeferredPages;
+	}
+	const auto deferred = [](not_null<Element*> view) {
+		return view->deferredResize();
+	};
+	if (ranges::any_of(_items, deferred)) {
+		_resizeDeferredTimer.callOnce(0);
+	} else {
+		_resizeDeferredPages = 0;
+	}
+}
+
 void ListWidget::restoreScrollPosition() {
 	auto newVisibleTop = _visibleTopItem
 		? (itemTop(_visibleTopItem) + _visibleTopFromItem)
@@ -479,6 +479,8 @@ private:
 	void updateVisibleTopItem();
 	void updateItemsGeometry();
 	void updateSize();
+	bool resizeDeferredItems(int from, int till, crl::time deadline);
+	void resizeDeferredItemsByTimer();
 	void refreshAttachmentsFromTill(int from, int till);
 	void refreshAttachmentsAtIndex(int index);
 
@@ -670,6 +672,11 @@ private:
 	base::Timer _scrollDateHideTimer;
 	Element *_scrollDateLastItem = nullptr;
 	int _scrollDateLastItemTop = 0;
+
+	// Far elements are laid out for the new width in slices,
+	// the window around the visible area grows with each slice.
+	base::Timer _resizeDeferredTimer;
+	int _resizeDeferredPages = 0;
 	ClickHandlerPtr _scrollDateLink;
 	SingleQueuedInvokation _applyUpdatedScrollState;
 
@@ -521,25 +521,46 @@ void Sticker::setGiftBoxSticker(bool giftBoxSticker) {
 void Sticker::setupPlayer() {
 	Expects(_dataMedia != nullptr);
 
-	if (_data->sticker()->isLottie()) {
-		_player = std::make_unique<LottiePlayer>(
-			ChatHelpers::LottiePlayerFromDocument(
-				_dataMedia.get(),
-				_replacements,
-				_cachingTag,
-				countOptimalSize() * style::DevicePixelRatio(),
-				Lottie::Quality::High));
-	} else if (_data->sticker()->isWebm()) {
-		_player = std::make_unique<WebmPlayer>(
-			_dataMedia->owner()->location(),
-			_dataMedia->bytes(),
-			countOptimalSize());
-	}
+	const auto size = countOptimalSize();
+	const auto create = [&]() -> std::unique_ptr<StickerPlayer> {
+		if (_data->sticker()->isLottie()) {
+			return std::make_unique<LottiePlayer>(
+				ChatHelpers::LottiePlayerFromDocument(
+					_dataMedia.get(),
+					_replacements,
+					_cachingTag,
+					size * style::DevicePixelRatio(),
+					Lottie::Quality::High));
+		} else if (_data->sticker()->isWebm()) {
+			return std::make_unique<WebmPlayer>(
+				_dataMedia->owner()->location(),
+				_dataMedia->bytes(),
+				size);
+		}
+		return nullptr;
+	};
+	_player = sharesPlayer()
+		? SharedStickerPlayer::Make({
+			.session = &_data->session(),
+			.documentId = _data->id,
+			.replacements = _replacements,
+			.cachingTag = int(_cachingTag),
+			.width = size.width(),
+			.height = size.height(),
+		}, create)
+		: create();
 
 	checkPremiumEffectStart();
 	playerCreated();
 }
 
+bool Sticker::sharesPlayer() const {
+	// Dice and the stickers played once track their own frames.
+	return (_diceIndex < 0)
+		&& (customEmojiPart() || !isEmojiSticker())
+		&& Core::App().settings().loopAnimatedStickers();
+}
+
 void Sticker::checkPremiumEffectStart() {
 	if (!_premiumEffectPlayed && hasPremiumEffect()) {
 		_premiumEffectPlayed = true;
@@ -110,6 +110,7 @@ private:
 	void dataMediaCreated() const;
 
 	void setupPlayer();
+	[[nodiscard]] bool sharesPlayer() const;
 	void playerCreated();
 	void unloadPlayer();
 	void emojiStickerClicked();
@@ -8,12 +8,72 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "history/view/media/history_view_sticker_player.h"
 
 #include "core/file_location.h"
+#include "main/main_session.h"
+
+#include <deque>
 
 namespace HistoryView {
+
+struct SharedStickerPlayer::Shared {
+	SharedStickerPlayerKey key;
+	std::unique_ptr<StickerPlayer> player;
+	rpl::event_stream<> repaints;
+	int shownFrameIndex = -1;
+};
+
 namespace {
 
 using ClipNotification = ::Media::Clip::Notification;
 
+constexpr auto kKeepReleasedPlayers = 8;
+
+using SharedPlayer = SharedStickerPlayer::Shared;
+
+// Accessed from the main thread only.
+base::flat_map<
+	SharedStickerPlayerKey,
+	std::weak_ptr<SharedPlayer>> SharedPlayers;
+std::deque<std::shared_ptr<SharedPlayer>> ReleasedPlayers;
+base::flat_set<not_null<Main::Session*>> TrackedSessions;
+
+void ForgetReleased(not_null<SharedPlayer*> shared) {
+	const auto i = ranges::find(
+		ReleasedPlayers,
+		shared.get(),
+		&std::shared_ptr<SharedPlayer>::get);
+	if (i != end(ReleasedPlayers)) {
+		ReleasedPlayers.erase(i);
+	}
+}
+
+void DropReleased(std::shared_ptr<SharedPlayer> shared) {
+	const auto key = shared->key;
+	shared = nullptr;
+	const auto i = SharedPlayers.find(key);
+	if (i != end(SharedPlayers) && i->second.expired()) {
+		SharedPlayers.erase(i);
+	}
+}
+
+void TrackSession(not_null<Main::Session*> session) {
+	if (!TrackedSessions.emplace(session).second) {
+		return;
+	}
+	// Players use the session caches, don't let them outlive it.
+	session->lifetime().add([=] {
+		TrackedSessions.remove(session);
+		for (auto i = begin(ReleasedPlayers); i != end(ReleasedPlayers);) {
+			if ((*i)->key.session == session) {
+				auto shared = std::move(*i);
+				i = ReleasedPlayers.erase(i);
+				DropReleased(std::move(shared));
+			} else {
+				++i;
+			}
+		}
+	});
+}
+
 } // namespace
 
 LottiePlayer::LottiePlayer(std::unique_ptr<Lottie::SinglePlayer> lottie)
@@ -157,4 +217,89 @@ bool StaticStickerPlayer::markFrameShown() {
 	return false;
 }
 
+SharedStickerPlayer::SharedStickerPlayer(std::shared_ptr<Shared> shared)
+: _shared(std::move(shared)) {
+}
+
+SharedStickerPlayer::~SharedStickerPlayer() {
+	_repaintLifetime.destroy();
+	if (_shared.use_count() > 1) {
+		return;
+	}
+	ReleasedPlayers.push_front(base::take(_shared));
+	while (ReleasedPlayers.size() > kKeepReleasedPlayers) {
+		auto oldest = std::move(ReleasedPlayers.back());
+		ReleasedPlayers.pop_back();
+		DropReleased(std::move(oldest));
+	}
+}
+
+std::unique_ptr<StickerPlayer> SharedStickerPlayer::Make(
+		const SharedStickerPlayerKey &key,
+		FnMut<std::unique_ptr<StickerPlayer>()> create) {
+	Expects(key.session != nullptr);
+
+	TrackSession(key.session);
+	auto &weak = SharedPlayers[key];
+	if (auto shared = weak.lock()) {
+		ForgetReleased(shared.get());
+		return std::make_unique<SharedStickerPlayer>(std::move(shared));
+	}
+	auto player = create();
+	if (!player) {
+		SharedPlayers.remove(key);
+		return nullptr;
+	}
+	auto shared = std::make_shared<Shared>(Shared{
+		.key = key,
+		.player = std::move(player),
+	});
+	const auto raw = shared.get();
+	raw->player->setRepaintCallback([=] { raw->repaints.fire({}); });
+	weak = shared;
+	return std::make_unique<SharedStickerPlayer>(std::move(shared));
+}
+
+void SharedStickerPlayer::setRepaintCallback(Fn<void()> callback) {
+	_repaintLifetime.destroy();
+	_shared->repaints.events(
+	) | rpl::start_with_next(callback, _repaintLifetime);
+	if (_shared->player->ready()) {
+		callback();
+	}
+}
+
+bool SharedStickerPlayer::ready() {
+	return _shared->player->ready();
+}
+
+int SharedStickerPlayer::framesCount() {
+	return _shared->player->framesCount();
+}
+
+SharedStickerPlayer::FrameInfo SharedStickerPlayer::frame(
+		QSize size,
+		QColor colored,
+		bool mirrorHorizontal,
+		crl::time now,
+		bool paused) {
+	auto result = _shared->player->frame(
+		size,
+		colored,
+		mirrorHorizontal,
+		now,
+		paused);
+	_frameIndex = result.index;
+	return result;
+}
+
+bool SharedStickerPlayer::markFrameShown() {
+	// The first view showing a frame moves the player to the next one.
+	if (_frameIndex == _shared->shownFrameIndex) {
+		return false;
+	}
+	_shared->shownFrameIndex = _frameIndex;
+	return _shared->player->markFrameShown();
+}
+
 } // namespace HistoryView
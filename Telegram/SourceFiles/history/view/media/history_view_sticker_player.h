@@ -16,6 +16,10 @@ namespace Core {
 class FileLocation;
 } // namespace Core
 
+namespace Main {
+class Session;
+} // namespace Main
+
 namespace HistoryView {
 
 class LottiePlayer final : public StickerPlayer {
@@ -89,4 +93,49 @@ private:
 
 };
 
+struct SharedStickerPlayerKey {
+	Main::Session *session = nullptr;
+	uint64 documentId = 0;
+	const Lottie::ColorReplacements *replacements = nullptr;
+	int cachingTag = 0;
+	int width = 0;
+	int height = 0;
+
+	friend inline auto operator<=>(
+		const SharedStickerPlayerKey&,
+		const SharedStickerPlayerKey&) = default;
+};
+
+// Identical looping stickers shown in several places at the same size
+// share one player, so each frame is rendered and kept only once.
+// A few recently released players are kept for the views coming back.
+class SharedStickerPlayer final : public StickerPlayer {
+public:
+	struct Shared;
+
+	explicit SharedStickerPlayer(std::shared_ptr<Shared> shared);
+	~SharedStickerPlayer();
+
+	[[nodiscard]] static std::unique_ptr<StickerPlayer> Make(
+		const SharedStickerPlayerKey &key,
+		FnMut<std::unique_ptr<StickerPlayer>()> create);
+
+	void setRepaintCallback(Fn<void()> callback) override;
+	bool ready() override;
+	int framesCount() override;
+	FrameInfo frame(
+		QSize size,
+		QColor colored,
+		bool mirrorHorizontal,
+		crl::time now,
+		bool paused) override;
+	bool markFrameShown() override;
+
+private:
+	std::shared_ptr<Shared> _shared;
+	rpl::lifetime _repaintLifetime;
+	int _frameIndex = -1;
+
+};
+
 } // namespace HistoryView
@@ -22,6 +22,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <QtCore/QThread>
 #include <QtCore/QFileInfo>
 
+#include <chrono>
+
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -34,9 +36,19 @@ namespace Clip {
 namespace {
 
 constexpr auto kClipThreadsCount = 8;
-constexpr auto kAverageGifSize = 320 * 240;
 constexpr auto kWaitBeforeGifPause = crl::time(200);
 
+// Thread load is counted in microseconds of decoding per second.
+// Until a reader decodes some frames its load is estimated.
+constexpr auto kEstimatedReaderLoad = 50'000;
+constexpr auto kMeasureLoadFrames = 4;
+
+[[nodiscard]] int64 NowMicroseconds() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(
+		steady_clock::now().time_since_epoch()).count();
+}
+
 QImage PrepareFrame(
 		const FrameRequest &request,
 		const QImage &original,
@@ -125,7 +137,7 @@ public:
 	~Manager();
 
 	int loadLevel() const {
-		return _loadLevel;
+		return _loadLevel.loadAcquire() + _pendingLoad.loadAcquire();
 	}
 	void append(Reader *reader, const Core::FileLocation &location, const QByteArray &data);
 	void start(Reader *reader);
@@ -140,6 +152,9 @@ private:
 	void clear();
 
 	QAtomicInt _loadLevel;
+
+	// Estimated load of the readers appended after the last process().
+	QAtomicInt _pendingLoad;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
 	ReaderPointers _readerPointers;
 	mutable QMutex _readerPointersMutex;
@@ -639,7 +654,35 @@ public:
 		_accessed = false;
 	}
 
+	void countDecodeTime(int64 decodeTime, crl::time frameDuration) {
+		_decodeTimeTotal += decodeTime;
+		++_framesDecoded;
+
+		const auto load = int(std::min(
+			decodeTime * 1000 / std::max(frameDuration, crl::time(1)),
+			int64(1'000'000)));
+		_load = (_framesDecoded > 1) ? ((_load * 7 + load) / 8) : load;
+	}
+
+	// Paused readers don't decode anything.
+	[[nodiscard]] int load() const {
+		return (_autoPausedGif || _videoPausedAtMs)
+			? 0
+			: (_framesDecoded < kMeasureLoadFrames)
+			? kEstimatedReaderLoad
+			: _load;
+	}
+
 	~ReaderPrivate() {
+		if (_framesDecoded > 0) {
+			DEBUG_LOG(("Clip Info: %1x%2, decoded %3 frames, "
+				"%4 us per frame on average, load %5 us per second."
+				).arg(_width
+				).arg(_height
+				).arg(_framesDecoded
+				).arg(_decodeTimeTotal / _framesDecoded
+				).arg(_load));
+		}
 		stop();
 		_data.clear();
 	}
@@ -687,6 +730,11 @@ private:
 	bool _started = false;
 	crl::time _videoPausedAtMs = 0;
 
+	// Decoding time statistics, in microseconds.
+	int64 _decodeTimeTotal = 0;
+	int _framesDecoded = 0;
+	int _load = 0;
+
 	friend class Manager;
 
 };
@@ -703,8 +751,12 @@ Manager::Manager(not_null<QThread*> thread) {
 
 void Manager::append(Reader *reader, const Core::FileLocation &location, const QByteArray &data) {
 	reader->_private = new ReaderPrivate(reader, location, data);
-	_loadLevel.fetchAndAddRelaxed(kAverageGifSize);
-	update(reader);
+
+	QMutexLocker lock(&_readerPointersMutex);
+	// Counted in full in process(), account for it until then.
+	_pendingLoad.fetchAndAddRelaxed(kEstimatedReaderLoad);
+	_readerPointers.insert(reader, QAtomicInt(1));
+	InvokeQueued(this, [=] { process(); });
 }
 
 void Manager::start(Reader *reader) {
@@ -783,7 +835,6 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, c
 	}
 
 	if (result == ProcessResult::Started) {
-		_loadLevel.fetchAndAddRelaxed(reader->_width * reader->_height - kAverageGifSize);
 		it.key()->_durationMs = reader->_durationMs;
 	}
 	// See if we need to pause GIF because it is not displayed right now.
@@ -826,7 +877,6 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, c
 
 Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessResult result, crl::time ms) {
 	if (!handleProcessResult(reader, result, ms)) {
-		_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : kAverageGifSize));
 		delete reader;
 		return ResultHandleRemove;
 	}
@@ -851,7 +901,15 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 				reader->_frame = index;
 			}
 		}
-		return handleResult(reader, reader->finishProcess(ms), ms);
+		const auto previousFrameWhen = reader->_nextFrameWhen;
+		const auto decodeStarted = NowMicroseconds();
+		const auto finished = reader->finishProcess(ms);
+		if (finished == ProcessResult::CopyFrame) {
+			reader->countDecodeTime(
+				NowMicroseconds() - decodeStarted,
+				reader->_nextFrameWhen - previousFrameWhen);
+		}
+		return handleResult(reader, finished, ms);
 	}
 
 	return ResultHandleContinue;
@@ -868,8 +926,13 @@ void Manager::process() {
 
 	bool checkAllReaders = false;
 	auto ms = crl::now(), minms = ms + 86400 * crl::time(1000);
+	auto pendingTaken = 0;
 	{
 		QMutexLocker lock(&_readerPointersMutex);
+
+		// All the appended readers are taken now, the estimate is removed
+		// only after the sum of the readers loads is updated below.
+		pendingTaken = _pendingLoad.loadAcquire();
 		for (auto it = _readerPointers.begin(), e = _readerPointers.end(); it != e; ++it) {
 			if (it->loadAcquire() && it.key()->_private != nullptr) {
 				auto i = _readers.find(it.key()->_private);
@@ -917,7 +980,6 @@ void Manager::process() {
 			QMutexLocker lock(&_readerPointersMutex);
 			auto it = constUnsafeFindReaderPointer(reader);
 			if (it == _readerPointers.cend()) {
-				_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : kAverageGifSize));
 				delete reader;
 				i = _readers.erase(i);
 				continue;
@@ -929,6 +991,14 @@ void Manager::process() {
 		++i;
 	}
 
+	// New readers are placed on the thread with the least measured load.
+	auto load = 0;
+	for (auto i = _readers.cbegin(), e = _readers.cend(); i != e; ++i) {
+		load += i.key()->load();
+	}
+	_loadLevel.storeRelease(load);
+	_pendingLoad.fetchAndAddRelaxed(-pendingTaken);
+
 	ms = crl::now();
 	if (_needReProcess || minms <= ms) {
 		_needReProcess = false;
@@ -21,12 +21,25 @@ constexpr auto kInSlice = uint32(kPartsInSlice * kPartSize);
 constexpr auto kMaxPartsInHeader = 64;
 constexpr auto kMaxOnlyInHeader = 80 * kPartSize;
 constexpr auto kPartsOutsideFirstSliceGood = 8;
+
+// Least recently used slices above the limit are unloaded. The memory
+// budget is split between the active readers, but a single reader never
+// keeps more than kMaxSlicesInMemory, so one video can't take it all.
 constexpr auto kSlicesInMemory = 2;
+constexpr auto kMaxSlicesInMemory = 4;
+constexpr auto kSlicesMemoryBudget = int64(64 * 1024 * 1024);
 
-// 1 MB of parts are requested from cloud ahead of reading demand.
+// At least kPreloadPartsAhead parts are requested from cloud ahead of
+// reading demand, more if the measured reading speed (which includes
+// the playback speed) requires it to stay kPreloadAheadTime ahead.
 constexpr auto kPreloadPartsAhead = 8;
+constexpr auto kMaxPreloadPartsAhead = kPartsInSlice / 2;
+constexpr auto kPreloadAheadTime = 4 * crl::time(1000);
+constexpr auto kReadSpeedInterval = crl::time(1000);
 constexpr auto kDownloaderRequestsLimit = 8;
 
+std::atomic<int> ActiveReaders = 0;
+
 using PartsMap = base::flat_map<uint32, QByteArray>;
 
 struct ParsedCacheEntry {
@@ -55,6 +68,15 @@ bool ComputeIsGoodHeader(int64 size, const PartsMap &header) {
 	return (outsideFirstSlice <= kPartsOutsideFirstSliceGood);
 }
 
+int SlicesInMemoryLimit() {
+	const auto inSlice = int64(kPartsInSlice) * cNetDownloadChunkSize();
+	const auto readers = std::max(ActiveReaders.load(), 1);
+	return std::clamp(
+		int(kSlicesMemoryBudget / (inSlice * readers)),
+		kSlicesInMemory,
+		kMaxSlicesInMemory);
+}
+
 int SlicesCount(uint32 size) {
 	const auto inSlice = uint32(kPartsInSlice * cNetDownloadChunkSize());
 	const auto result = (size + inSlice - 1) / inSlice;
@@ -233,6 +255,7 @@ struct Reader::CacheHelper {
 	QMutex mutex;
 	base::flat_map<uint32, PartsMap> results;
 	std::vector<int> sizes;
+	int found = 0; // Slices that were found in the cache database.
 	std::atomic<crl::semaphore*> waiting = nullptr;
 };
 
@@ -272,13 +295,14 @@ void Reader::Slice::addPart(uint32 offset, QByteArray bytes) {
 
 auto Reader::Slice::prepareFill(
 		uint32 from,
-		uint32 till) -> PrepareFillResult {
+		uint32 till,
+		int preloadParts) -> PrepareFillResult {
 	auto result = PrepareFillResult();
 
 	result.ready = false;
 	const auto fromOffset = (from / cNetDownloadChunkSize()) * cNetDownloadChunkSize();
 	const auto tillPart = (till + cNetDownloadChunkSize() - 1) / cNetDownloadChunkSize();
-	const auto preloadTillOffset = (tillPart + kPreloadPartsAhead)
+	const auto preloadTillOffset = (tillPart + preloadParts)
 		* cNetDownloadChunkSize();
 
 	const auto after = ranges::upper_bound(
@@ -553,7 +577,10 @@ void Reader::Slices::processPart(
 	checkSliceFullLoaded(index + 1);
 }
 
-auto Reader::Slices::fill(uint32 offset, bytes::span buffer) -> FillResult {
+auto Reader::Slices::fill(
+		uint32 offset,
+		bytes::span buffer,
+		int preloadParts) -> FillResult {
 	const auto inSlice = uint32(kPartsInSlice * cNetDownloadChunkSize());
 
 	Expects(!buffer.empty());
@@ -569,7 +596,7 @@ auto Reader::Slices::fill(uint32 offset, bytes::span buffer) -> FillResult {
 		Assert(waitingForHeaderCache());
 		return {};
 	} else if (isFullInHeader()) {
-		return fillFromHeader(offset, buffer);
+		return fillFromHeader(offset, buffer, preloadParts);
 	}
 
 	auto result = FillResult();
@@ -612,9 +639,15 @@ auto Reader::Slices::fill(uint32 offset, bytes::span buffer) -> FillResult {
 	const auto secondTill = (till > (fromSlice + 1) * inSlice)
 		? (till - (fromSlice + 1) * inSlice)
 		: 0;
-	const auto first = _data[fromSlice].prepareFill(firstFrom, firstTill);
+	const auto first = _data[fromSlice].prepareFill(
+		firstFrom,
+		firstTill,
+		preloadParts);
 	const auto second = (fromSlice + 1 < tillSlice)
-		? _data[fromSlice + 1].prepareFill(secondFrom, secondTill)
+		? _data[fromSlice + 1].prepareFill(
+			secondFrom,
+			secondTill,
+			preloadParts)
 		: Slice::PrepareFillResult();
 	handlePrepareResult(fromSlice, first);
 	if (fromSlice + 1 < tillSlice) {
@@ -646,13 +679,15 @@ auto Reader::Slices::fill(uint32 offset, bytes::span buffer) -> FillResult {
 	return result;
 }
 
-auto Reader::Slices::fillFromHeader(uint32 offset, bytes::span buffer)
--> FillResult {
+auto Reader::Slices::fillFromHeader(
+		uint32 offset,
+		bytes::span buffer,
+		int preloadParts) -> FillResult {
 	auto result = FillResult();
 	const auto from = offset;
 	const auto till = uint32(offset + buffer.size());
 
-	const auto prepared = _header.prepareFill(from, till);
+	const auto prepared = _header.prepareFill(from, till, preloadParts);
 	for (const auto full : prepared.offsetsFromLoader.values()) {
 		if (full < _size) {
 			result.offsetsFromLoader.add(full);
@@ -722,7 +757,7 @@ Reader::SerializedSlice Reader::Slices::serializeAndUnloadUnused() {
 	using Flag = Slice::Flag;
 
 	if (_headerMode == HeaderMode::Unknown
-		|| _usedSlices.size() <= kSlicesInMemory) {
+		|| _usedSlices.size() <= SlicesInMemoryLimit()) {
 		return {};
 	}
 	const auto purgeSlice = _usedSlices.front();
@@ -854,6 +889,8 @@ Reader::Reader(
 , _cache(cache)
 , _cacheHelper(cache ? InitCacheHelper(_loader->baseCacheKey()) : nullptr)
 , _slices(_loader->size(), _cacheHelper != nullptr) {
+	++ActiveReaders;
+
 	_loader->parts(
 	) | rpl::start_with_next([=](LoadedPart &&part) {
 		if (_attachedDownloader) {
@@ -1123,6 +1160,16 @@ bool Reader::isRemoteLoader() const {
 	return _loader->baseCacheKey().valid();
 }
 
+Reader::Statistics Reader::statistics() const {
+	return {
+		.fills = _statFills.load(),
+		.filledFromMemory = _statFilledFromMemory.load(),
+		.slicesFromCache = _statSlicesFromCache.load(),
+		.partsFromRemote = _statPartsFromRemote.load(),
+		.stalled = _statStalled.load(),
+	};
+}
+
 std::shared_ptr<Reader::CacheHelper> Reader::InitCacheHelper(
 		Storage::Cache::Key baseKey) {
 	if (!baseKey) {
@@ -1152,12 +1199,16 @@ void Reader::readFromCache(int sliceNumber) {
 			result = std::move(result),
 			sizes = std::move(sizes)
 		]() mutable{
+			const auto found = !result.isEmpty();
 			auto entry = ParseCacheEntry(
 				bytes::make_span(result),
 				sliceNumber,
 				size);
 			if (const auto strong = cache.lock()) {
 				QMutexLocker lock(&strong->mutex);
+				if (found) {
+					++strong->found;
+				}
 				strong->results.emplace(sliceNumber, std::move(entry.parts));
 				if (!sliceNumber && entry.included) {
 					strong->results.emplace(1, std::move(*entry.included));
@@ -1240,8 +1291,9 @@ Reader::FillState Reader::fill(
 			_cacheHelper->waiting.store(nullptr, std::memory_order_release);
 		}
 	};
-	const auto done = [&] {
+	const auto done = [&](bool waited) {
 		clearWaiting();
+		fillFinished(buffer.size(), waited);
 		return FillState::Success;
 	};
 	const auto failed = [&] {
@@ -1256,21 +1308,66 @@ Reader::FillState Reader::fill(
 	}
 
 	auto lastResult = FillState();
+	auto waited = (_stallStart != 0);
 	do {
 		lastResult = fillFromSlices(uint32(offset), buffer);
 		if (lastResult == FillState::Success) {
-			return done();
+			return done(waited);
 		}
+		waited = true;
 		startWaiting();
 	} while (checkForSomethingMoreReceived());
 
+	if (!_stallStart) {
+		_stallStart = crl::now();
+	}
 	return _streamingError ? failed() : lastResult;
 }
 
+void Reader::fillFinished(int64 size, bool waited) {
+	++_statFills;
+	if (!waited) {
+		++_statFilledFromMemory;
+	}
+	if (_stallStart) {
+		_statStalled += (crl::now() - base::take(_stallStart));
+	}
+	updatePreloadPartsAhead(size);
+}
+
+void Reader::updatePreloadPartsAhead(int64 size) {
+	const auto now = crl::now();
+	if (!_readSpeedStart) {
+		_readSpeedStart = now;
+	}
+	_readSpeedBytes += size;
+	const auto elapsed = now - _readSpeedStart;
+	if (elapsed < kReadSpeedInterval) {
+		return;
+	}
+	const auto speed = _readSpeedBytes * 1000 / elapsed;
+	_readBytesPerSecond = _readBytesPerSecond
+		? ((_readBytesPerSecond + speed) / 2)
+		: speed;
+	_readSpeedStart = now;
+	_readSpeedBytes = 0;
+
+	const auto ahead = _readBytesPerSecond * kPreloadAheadTime / 1000;
+	const auto parts = (ahead + cNetDownloadChunkSize() - 1)
+		/ cNetDownloadChunkSize();
+	_preloadPartsAhead = int(std::clamp(
+		parts,
+		int64(kPreloadPartsAhead),
+		int64(kMaxPreloadPartsAhead)));
+}
+
 Reader::FillState Reader::fillFromSlices(uint32 offset, bytes::span buffer) {
 	using namespace rpl::mappers;
 
-	auto result = _slices.fill(offset, buffer);
+	const auto preloadParts = _preloadPartsAhead
+		? _preloadPartsAhead
+		: kPreloadPartsAhead;
+	auto result = _slices.fill(offset, buffer, preloadParts);
 	if (result.state != FillState::Success && _slices.headerWontBeFilled()) {
 		_streamingError = Error::NotStreamable;
 		return FillState::Failed;
@@ -1326,6 +1423,7 @@ bool Reader::processCacheResults() {
 	QMutexLocker lock(&_cacheHelper->mutex);
 	auto loaded = base::take(_cacheHelper->results);
 	auto sizes = base::take(_cacheHelper->sizes);
+	_statSlicesFromCache += base::take(_cacheHelper->found);
 	lock.unlock();
 
 	for (auto &[sliceNumber, cachedParts] : _downloaderReadCache) {
@@ -1368,6 +1466,7 @@ bool Reader::processLoadedParts() {
 		} else if (!_loadingOffsets.remove(part.offset)) {
 			continue;
 		}
+		++_statPartsFromRemote;
 		_slices.processPart(
 			part.offset,
 			std::move(part.bytes));
@@ -1406,6 +1505,18 @@ void Reader::finalizeCache() {
 
 Reader::~Reader() {
 	finalizeCache();
+	--ActiveReaders;
+
+	const auto statistics = this->statistics();
+	if (statistics.fills) {
+		DEBUG_LOG(("Streaming Info: Reader fills: %1, memory hit ratio: %2, "
+			"slices from cache: %3, parts from remote: %4, stalled: %5ms."
+			).arg(statistics.fills
+			).arg(statistics.hitRatio()
+			).arg(statistics.slicesFromCache
+			).arg(statistics.partsFromRemote
+			).arg(statistics.stalled));
+	}
 }
 
 QByteArray SerializeComplexPartsMap(
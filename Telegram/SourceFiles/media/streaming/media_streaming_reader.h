@@ -39,6 +39,18 @@ public:
 		Failed,
 	};
 
+	struct Statistics {
+		int64 fills = 0;
+		int64 filledFromMemory = 0;
+		int64 slicesFromCache = 0;
+		int64 partsFromRemote = 0;
+		crl::time stalled = 0;
+
+		[[nodiscard]] float64 hitRatio() const {
+			return fills ? (filledFromMemory / float64(fills)) : 1.;
+		}
+	};
+
 	// Main thread.
 	explicit Reader(
 		std::unique_ptr<Loader> loader,
@@ -49,6 +61,7 @@ public:
 	// Any thread.
 	[[nodiscard]] int64 size() const;
 	[[nodiscard]] bool isRemoteLoader() const;
+	[[nodiscard]] Statistics statistics() const;
 
 	// Single thread.
 	[[nodiscard]] FillState fill(
@@ -132,7 +145,10 @@ private:
 
 		void processCacheData(PartsMap &&data);
 		void addPart(uint32 offset, QByteArray bytes);
-		PrepareFillResult prepareFill(uint32 from, uint32 till);
+		PrepareFillResult prepareFill(
+			uint32 from,
+			uint32 till,
+			int preloadParts);
 
 		// Get up to kLoadFromRemoteMax not loaded parts in from-till range.
 		StackIntVector<kLoadFromRemoteMax> offsetsFromLoader(
@@ -163,7 +179,10 @@ private:
 		void processCachedSizes(const std::vector<int> &sizes);
 		void processPart(uint32 offset, QByteArray &&bytes);
 
-		[[nodiscard]] FillResult fill(uint32 offset, bytes::span buffer);
+		[[nodiscard]] FillResult fill(
+			uint32 offset,
+			bytes::span buffer,
+			int preloadParts);
 		[[nodiscard]] SerializedSlice unloadToCache();
 
 		[[nodiscard]] QByteArray partForDownloader(uint32 offset) const;
@@ -190,7 +209,8 @@ private:
 		[[nodiscard]] bool computeIsGoodHeader() const;
 		[[nodiscard]] FillResult fillFromHeader(
 			uint32 offset,
-			bytes::span buffer);
+			bytes::span buffer,
+			int preloadParts);
 		void unloadSlice(Slice &slice) const;
 		void checkSliceFullLoaded(int sliceNumber);
 		[[nodiscard]] bool checkFullInCache() const;
@@ -219,6 +239,8 @@ private:
 	bool checkForSomethingMoreReceived();
 
 	FillState fillFromSlices(uint32 offset, bytes::span buffer);
+	void fillFinished(int64 size, bool waited);
+	void updatePreloadPartsAhead(int64 size);
 
 	void finalizeCache();
 
@@ -254,6 +276,20 @@ private:
 	// Even if streaming had failed, the Reader can work for the downloader.
 	std::optional<Error> _streamingError;
 
+	// Streaming thread.
+	int _preloadPartsAhead = 0;
+	crl::time _readSpeedStart = 0;
+	int64 _readSpeedBytes = 0;
+	int64 _readBytesPerSecond = 0;
+	crl::time _stallStart = 0;
+
+	// Any thread.
+	std::atomic<int64> _statFills = 0;
+	std::atomic<int64> _statFilledFromMemory = 0;
+	std::atomic<int64> _statSlicesFromCache = 0;
+	std::atomic<int64> _statPartsFromRemote = 0;
+	std::atomic<crl::time> _statStalled = 0;
+
 	// In case streaming is active both main and streaming threads have work.
 	// In case only downloader is active, all work is done on main thread.
 
@@ -24,7 +24,8 @@ static_assert(kDisplaySkipped != kTimeUnknown);
 
 [[nodiscard]] QImage ConvertToARGB32(
 		FrameFormat format,
-		const FrameYUV &data) {
+		const FrameYUV &data,
+		FFmpeg::SwscalePointer &swscale) {
 	Expects(data.y.data != nullptr);
 	Expects(data.u.data != nullptr);
 	Expects((format == FrameFormat::NV12) || (data.v.data != nullptr));
@@ -35,13 +36,17 @@ static_assert(kDisplaySkipped != kTimeUnknown);
 	//}
 
 	auto result = FFmpeg::CreateFrameStorage(data.size);
-	const auto swscale = FFmpeg::MakeSwscalePointer(
+
+	// Creating the context initializes the conversion tables and filters,
+	// so we reuse it while the frame size and format stay the same.
+	swscale = FFmpeg::MakeSwscalePointer(
 		data.size,
 		(format == FrameFormat::YUV420
 			? AV_PIX_FMT_YUV420P
 			: AV_PIX_FMT_NV12),
 		data.size,
-		AV_PIX_FMT_BGRA);
+		AV_PIX_FMT_BGRA,
+		&swscale);
 	if (!swscale) {
 		return QImage();
 	}
@@ -1214,7 +1219,10 @@ QImage VideoTrack::frameImage(
 	if (frame->original.isNull()
 		&& (frame->format == FrameFormat::YUV420
 			|| frame->format == FrameFormat::NV12)) {
-		frame->original = ConvertToARGB32(frame->format, frame->yuv);
+		frame->original = ConvertToARGB32(
+			frame->format,
+			frame->yuv,
+			_argb32Swscale);
 	}
 	if (GoodForRequest(
 			frame->original,
@@ -1255,7 +1263,10 @@ QImage VideoTrack::currentFrameImage() {
 	if (frame->original.isNull()
 		&& (frame->format == FrameFormat::YUV420
 			|| frame->format == FrameFormat::NV12)) {
-		frame->original = ConvertToARGB32(frame->format, frame->yuv);
+		frame->original = ConvertToARGB32(
+			frame->format,
+			frame->yuv,
+			_argb32Swscale);
 	}
 	return frame->original;
 }
@@ -177,6 +177,9 @@ private:
 	const AVRational _streamAspect = FFmpeg::kNormalAspect;
 	std::unique_ptr<Shared> _shared;
 
+	// Used from the main thread for YUV frames painted as ARGB32.
+	FFmpeg::SwscalePointer _argb32Swscale;
+
 	using Implementation = VideoTrackObject;
 	crl::object_on_queue<Implementation> _wrapped;
 
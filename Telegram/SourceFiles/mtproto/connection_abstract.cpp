@@ -18,10 +18,41 @@ namespace MTP {
 namespace details {
 namespace {
 
+constexpr auto kCopiedBytesLogInterval = crl::time(1000);
+
 std::atomic<int> GlobalConnectionCounter/* = 0*/;
+std::atomic<int64> ReceivedBytes/* = 0*/;
+std::atomic<int64> CopiedBytes/* = 0*/;
+std::atomic<crl::time> CopiedBytesLogged/* = 0*/;
+
+void LogCopiedBytes() {
+	const auto now = crl::now();
+	auto logged = CopiedBytesLogged.load();
+	if (now < logged + kCopiedBytesLogInterval
+		|| !CopiedBytesLogged.compare_exchange_strong(logged, now)) {
+		return;
+	}
+	const auto received = ReceivedBytes.exchange(0);
+	const auto copied = CopiedBytes.exchange(0);
+	if (logged && received) {
+		const auto duration = now - logged;
+		DEBUG_LOG(("MTP Info: received %1 bytes/s, copied %2 bytes/s."
+			).arg(received * 1000 / duration
+			).arg(copied * 1000 / duration));
+	}
+}
 
 } // namespace
 
+void CountReceivedBytes(int64 bytes) {
+	ReceivedBytes += bytes;
+	LogCopiedBytes();
+}
+
+void CountCopiedBytes(int64 bytes) {
+	CopiedBytes += bytes;
+}
+
 ConnectionPointer::ConnectionPointer() = default;
 
 ConnectionPointer::ConnectionPointer(std::nullptr_t) {
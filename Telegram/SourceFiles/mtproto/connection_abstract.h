@@ -28,6 +28,11 @@ class AbstractConnection;
 
 inline constexpr auto kTestModeDcIdShift = 10000;
 
+// Bytes received from all the connections and bytes copied on their way
+// from the socket to the request handlers, logged once in a second.
+void CountReceivedBytes(int64 bytes);
+void CountCopiedBytes(int64 bytes);
+
 class ConnectionPointer {
 public:
 	ConnectionPointer();
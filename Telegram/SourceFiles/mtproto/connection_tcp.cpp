@@ -257,28 +257,42 @@ ConnectionPointer TcpConnection::clone(const ProxyData &proxy) {
 	return ConnectionPointer::New<TcpConnection>(_instance, thread(), proxy);
 }
 
+bytes::span TcpConnection::largeBufferBytes() {
+	return bytes::make_span(
+		reinterpret_cast<bytes::type*>(_largeBuffer.data()),
+		_largeBuffer.size() * sizeof(mtpPrime));
+}
+
 void TcpConnection::ensureAvailableInBuffer(int amount) {
-	auto &buffer = _usingLargeBuffer ? _largeBuffer : _smallBuffer;
-	const auto full = bytes::make_span(buffer).subspan(
-		_offsetBytes);
+	const auto full = (_usingLargeBuffer
+		? largeBufferBytes()
+		: bytes::make_span(_smallBuffer)).subspan(_offsetBytes);
 	if (full.size() >= amount) {
 		return;
 	}
 	const auto read = full.subspan(0, _readBytes);
+	CountCopiedBytes(read.size());
 	if (amount <= _smallBuffer.size()) {
 		if (_usingLargeBuffer) {
 			bytes::copy(_smallBuffer, read);
 			_usingLargeBuffer = false;
-			_largeBuffer.clear();
+			_largeBuffer = mtpBuffer();
 		} else {
 			bytes::move(_smallBuffer, read);
 		}
-	} else if (amount <= _largeBuffer.size()) {
+	} else if (amount <= largeBufferBytes().size()) {
 		Assert(_usingLargeBuffer);
-		bytes::move(_largeBuffer, read);
+		bytes::move(largeBufferBytes(), read);
 	} else {
-		auto enough = bytes::vector(amount);
-		bytes::copy(enough, read);
+		// The packet is read right into the buffer that will be handed
+		// to the session, so it won't be copied once again after reading.
+		auto enough = mtpBuffer(
+			(amount + sizeof(mtpPrime) - 1) / sizeof(mtpPrime));
+		bytes::copy(
+			bytes::make_span(
+				reinterpret_cast<bytes::type*>(enough.data()),
+				enough.size() * sizeof(mtpPrime)),
+			read);
 		_largeBuffer = std::move(enough);
 		_usingLargeBuffer = true;
 	}
@@ -303,27 +317,33 @@ void TcpConnection::socketRead() {
 			: (kSmallBufferSize - _offsetBytes - _readBytes);
 		Assert(readLimit > 0);
 
-		auto &buffer = _usingLargeBuffer ? _largeBuffer : _smallBuffer;
-		const auto full = bytes::make_span(buffer).subspan(_offsetBytes);
+		const auto full = (_usingLargeBuffer
+			? largeBufferBytes()
+			: bytes::make_span(_smallBuffer)).subspan(_offsetBytes);
 		const auto free = full.subspan(_readBytes);
 		const auto readCount = _socket->read(free.subspan(0, readLimit));
 		if (readCount > 0) {
 			const auto read = free.subspan(0, readCount);
 			aesCtrEncrypt(read, _receiveKey, &_receiveState);
 			CONNECTION_LOG_INFO(u"Read %1 bytes"_q.arg(readCount));
+			CountReceivedBytes(readCount);
 
 			_readBytes += readCount;
 			if (_leftBytes > 0) {
 				Assert(readCount <= _leftBytes);
 				_leftBytes -= readCount;
 				if (!_leftBytes) {
-					socketPacket(full.subspan(0, _readBytes));
+					if (_usingLargeBuffer) {
+						socketLargePacket();
+					} else {
+						socketPacket(full.subspan(0, _readBytes));
+					}
 					if (!_socket || !_socket->isConnected()) {
 						return;
 					}
 
 					_usingLargeBuffer = false;
-					_largeBuffer.clear();
+					_largeBuffer = mtpBuffer();
 					_offsetBytes = _readBytes = 0;
 				} else {
 					CONNECTION_LOG_INFO(
@@ -405,6 +425,7 @@ mtpBuffer TcpConnection::parsePacket(bytes::const_span bytes) {
 	}
 	auto result = mtpBuffer(ints.size());
 	memcpy(result.data(), ints.data(), ints.size() * sizeof(mtpPrime));
+	CountCopiedBytes(ints.size() * sizeof(mtpPrime));
 	return result;
 }
 
@@ -582,10 +603,32 @@ crl::time TcpConnection::fullConnectTimeout() const {
 }
 
 void TcpConnection::socketPacket(bytes::const_span bytes) {
+	handlePacket(parsePacket(bytes));
+}
+
+void TcpConnection::socketLargePacket() {
+	Expects(_usingLargeBuffer);
+
+	const auto buffer = largeBufferBytes();
+	const auto packet = _protocol->readPacket(
+		buffer.subspan(_offsetBytes, _readBytes));
+	CONNECTION_LOG_INFO(u"Packet received, size = %1."_q.arg(packet.size()));
+
+	// Only the transport header is dropped, in place.
+	const auto ints = packet.size() / sizeof(mtpPrime);
+	if (packet.data() != buffer.data()) {
+		memmove(buffer.data(), packet.data(), ints * sizeof(mtpPrime));
+		CountCopiedBytes(ints * sizeof(mtpPrime));
+	}
+	auto data = base::take(_largeBuffer);
+	data.resize(ints);
+	handlePacket(std::move(data));
+}
+
+void TcpConnection::handlePacket(mtpBuffer &&data) {
 	Expects(_socket != nullptr);
 
 	// old quickack?..
-	const auto data = parsePacket(bytes);
 	if (data.size() == 1) {
 		if (data[0] != 0) {
 			error(data[0]);
@@ -595,7 +638,7 @@ void TcpConnection::socketPacket(bytes::const_span bytes) {
 	//} else if (data.size() == 2) {
 		// new quickack?..
 	} else if (_status == Status::Ready) {
-		_receivedQueue.push_back(data);
+		_receivedQueue.push_back(std::move(data));
 		receivedData();
 	} else if (_status == Status::Waiting) {
 		if (const auto res_pq = readPQFakeReply(data)) {
@@ -55,6 +55,8 @@ private:
 	bytes::const_span prepareConnectionStartPrefix(bytes::span buffer);
 
 	void socketPacket(bytes::const_span bytes);
+	void socketLargePacket();
+	void handlePacket(mtpBuffer &&data);
 
 	void socketConnected();
 	void socketDisconnected();
@@ -62,6 +64,7 @@ private:
 
 	mtpBuffer parsePacket(bytes::const_span bytes);
 	void ensureAvailableInBuffer(int amount);
+	[[nodiscard]] bytes::span largeBufferBytes();
 	static uint32 fourCharsToUInt(char ch1, char ch2, char ch3, char ch4) {
 		char ch[4] = { ch1, ch2, ch3, ch4 };
 		return *reinterpret_cast<uint32*>(ch);
@@ -75,7 +78,7 @@ private:
 	int _readBytes = 0;
 	int _leftBytes = 0;
 	bytes::vector _smallBuffer;
-	bytes::vector _largeBuffer;
+	mtpBuffer _largeBuffer; // Becomes the received packet itself.
 	bool _usingLargeBuffer = false;
 
 	uchar _sendKey[CTRState::KeySize];
@@ -10,8 +10,135 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "base/openssl_help.h"
 
 #include <QtCore/QDataStream>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
 
 namespace MTP {
+namespace {
+
+constexpr auto kAesBlockSize = 16;
+
+// Keystream for that many counter blocks is encrypted in one call,
+// so that the AES-NI / VAES code can process the blocks in parallel.
+constexpr auto kCtrBatchBlocks = 64;
+
+// Unlike the low level AES_* functions the EVP interface chooses
+// the AES-NI / VAES implementation at runtime if the CPU supports it.
+class EcbContext final {
+public:
+	EcbContext() : _context(EVP_CIPHER_CTX_new()) {
+		if (!_context) {
+			Unexpected("EVP_CIPHER_CTX_new in EcbContext.");
+		}
+	}
+	EcbContext(const EcbContext &other) = delete;
+	EcbContext &operator=(const EcbContext &other) = delete;
+	~EcbContext() {
+		EVP_CIPHER_CTX_free(_context);
+	}
+
+	void init(const void *key, bool encrypt) {
+		const auto result = EVP_CipherInit_ex(
+			_context,
+			EVP_aes_256_ecb(),
+			nullptr,
+			static_cast<const uchar*>(key),
+			nullptr,
+			encrypt ? 1 : 0);
+		if (result != 1) {
+			Unexpected("EVP_CipherInit_ex in EcbContext::init.");
+		}
+		EVP_CIPHER_CTX_set_padding(_context, 0);
+	}
+	void process(const uchar *from, uchar *to, int size) {
+		auto processed = 0;
+		const auto result = EVP_CipherUpdate(
+			_context,
+			to,
+			&processed,
+			from,
+			size);
+		if (result != 1 || processed != size) {
+			Unexpected("EVP_CipherUpdate in EcbContext::process.");
+		}
+	}
+
+	// Wipes the key schedule, it is not kept between the calls.
+	void clear() {
+		EVP_CIPHER_CTX_reset(_context);
+	}
+
+private:
+	EVP_CIPHER_CTX *_context = nullptr;
+
+};
+
+// One context for each thread is reused for all the packets,
+// only the key schedule is computed for each of them.
+[[nodiscard]] EcbContext &ThreadEcbContext() {
+	thread_local EcbContext result;
+	return result;
+}
+
+void XorBlock(uchar *to, const uchar *a, const uchar *b) {
+	uint64 x[2], y[2];
+	memcpy(x, a, kAesBlockSize);
+	memcpy(y, b, kAesBlockSize);
+	x[0] ^= y[0];
+	x[1] ^= y[1];
+	memcpy(to, x, kAesBlockSize);
+}
+
+void IncrementCounter(uchar *counter) {
+	for (auto i = kAesBlockSize; i != 0;) {
+		if (++counter[--i]) {
+			break;
+		}
+	}
+}
+
+// Same as AES_ige_encrypt, the first half of iv is the previous
+// ciphertext block and the second half is the previous plaintext block.
+void AesIge(
+		const void *src,
+		void *dst,
+		uint32 len,
+		const void *key,
+		const void *iv,
+		bool encrypt) {
+	Expects(len % kAesBlockSize == 0);
+
+	auto &context = ThreadEcbContext();
+	context.init(key, encrypt);
+
+	// Before the block function previous output is applied,
+	// after the block function previous input is applied.
+	uchar previousOutput[kAesBlockSize], previousInput[kAesBlockSize];
+	const auto ivBytes = static_cast<const uchar*>(iv);
+	memcpy(
+		previousOutput,
+		ivBytes + (encrypt ? 0 : kAesBlockSize),
+		kAesBlockSize);
+	memcpy(
+		previousInput,
+		ivBytes + (encrypt ? kAesBlockSize : 0),
+		kAesBlockSize);
+
+	auto from = static_cast<const uchar*>(src);
+	auto to = static_cast<uchar*>(dst);
+	uchar input[kAesBlockSize], block[kAesBlockSize];
+	for (auto i = uint32(); i != len; i += kAesBlockSize) {
+		memcpy(input, from + i, kAesBlockSize);
+		XorBlock(block, input, previousOutput);
+		context.process(block, block, kAesBlockSize);
+		XorBlock(to + i, block, previousInput);
+		memcpy(previousOutput, to + i, kAesBlockSize);
+		memcpy(previousInput, input, kAesBlockSize);
+	}
+	context.clear();
+}
+
+} // namespace
 
 AuthKey::AuthKey(Type type, DcId dcId, const Data &data)
 : _type(type)
@@ -149,41 +276,57 @@ void AuthKey::countKeyId() {
 }
 
 void aesIgeEncryptRaw(const void *src, void *dst, uint32 len, const void *key, const void *iv) {
-	uchar aes_key[32], aes_iv[32];
-	memcpy(aes_key, key, 32);
-	memcpy(aes_iv, iv, 32);
-
-	AES_KEY aes;
-	AES_set_encrypt_key(aes_key, 256, &aes);
-	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, aes_iv, AES_ENCRYPT);
+	AesIge(src, dst, len, key, iv, true);
 }
 
 void aesIgeDecryptRaw(const void *src, void *dst, uint32 len, const void *key, const void *iv) {
-	uchar aes_key[32], aes_iv[32];
-	memcpy(aes_key, key, 32);
-	memcpy(aes_iv, iv, 32);
-
-	AES_KEY aes;
-	AES_set_decrypt_key(aes_key, 256, &aes);
-	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, aes_iv, AES_DECRYPT);
+	AesIge(src, dst, len, key, iv, false);
 }
 
 void aesCtrEncrypt(bytes::span data, const void *key, CTRState *state) {
-	AES_KEY aes;
-	AES_set_encrypt_key(static_cast<const uchar*>(key), 256, &aes);
-
-	static_assert(CTRState::IvecSize == AES_BLOCK_SIZE, "Wrong size of ctr ivec!");
-	static_assert(CTRState::EcountSize == AES_BLOCK_SIZE, "Wrong size of ctr ecount!");
-
-	CRYPTO_ctr128_encrypt(
-		reinterpret_cast<const uchar*>(data.data()),
-		reinterpret_cast<uchar*>(data.data()),
-		data.size(),
-		&aes,
-		state->ivec,
-		state->ecount,
-		&state->num,
-		(block128_f)AES_encrypt);
+	static_assert(CTRState::IvecSize == kAesBlockSize, "Wrong size of ctr ivec!");
+	static_assert(CTRState::EcountSize == kAesBlockSize, "Wrong size of ctr ecount!");
+
+	auto &context = ThreadEcbContext();
+	context.init(key, true);
+
+	auto bytes = reinterpret_cast<uchar*>(data.data());
+	auto left = std::size_t(data.size());
+
+	// The rest of the keystream block from the previous call.
+	for (; state->num && left; --left) {
+		*bytes++ ^= state->ecount[state->num];
+		state->num = (state->num + 1) % kAesBlockSize;
+	}
+
+	uchar stream[kCtrBatchBlocks * kAesBlockSize];
+	while (left >= kAesBlockSize) {
+		const auto blocks = std::min(
+			left / kAesBlockSize,
+			std::size_t(kCtrBatchBlocks));
+		const auto size = blocks * kAesBlockSize;
+		for (auto i = std::size_t(); i != size; i += kAesBlockSize) {
+			memcpy(stream + i, state->ivec, kAesBlockSize);
+			IncrementCounter(state->ivec);
+		}
+		context.process(stream, stream, int(size));
+		for (auto i = std::size_t(); i != size; i += kAesBlockSize) {
+			XorBlock(bytes + i, bytes + i, stream + i);
+		}
+		bytes += size;
+		left -= size;
+	}
+
+	if (left) {
+		context.process(state->ivec, state->ecount, kAesBlockSize);
+		IncrementCounter(state->ivec);
+		for (auto i = std::size_t(); i != left; ++i) {
+			bytes[i] ^= state->ecount[i];
+		}
+		state->num = uint32(left);
+	}
+	context.clear();
+	OPENSSL_cleanse(stream, sizeof(stream));
 }
 
 } // namespace MTP
@@ -60,6 +60,9 @@ constexpr auto kSendStateRequestWaiting = crl::time(1000);
 // How much time to wait for some more requests, when sending msg acks.
 constexpr auto kAckSendWaiting = 10 * crl::time(1000);
 
+// How long background requests may wait while other requests are sent.
+constexpr auto kHoldBackgroundRequests = crl::time(300);
+
 auto SyncTimeRequestDuration = kFastRequestDuration;
 
 using namespace details;
@@ -96,6 +99,30 @@ using namespace details;
 	})();
 }
 
+// Leaves only user-visible requests in toSend, if there are any, so that
+// they go in a smaller container and their results come sooner.
+void HoldBackgroundRequests(
+		base::flat_map<mtpRequestId, SerializedRequest> &toSend,
+		base::flat_map<mtpRequestId, SerializedRequest> &held) {
+	const auto visible = ranges::any_of(toSend, [](const auto &pair) {
+		return !pair.second->background;
+	});
+	if (!visible) {
+		return;
+	}
+	const auto now = crl::now();
+	for (auto i = toSend.begin(); i != toSend.end();) {
+		const auto &request = i->second;
+		if (request->background
+			&& request->lastSentTime + kHoldBackgroundRequests > now) {
+			held.emplace(i->first, request);
+			i = toSend.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
 void WrapInvokeAfter(
 		SerializedRequest &to,
 		const SerializedRequest &from,
@@ -711,6 +738,15 @@ void SessionPrivate::tryToSend() {
 			locker1.unlock();
 		}
 
+		auto held = base::flat_map<mtpRequestId, SerializedRequest>();
+		HoldBackgroundRequests(toSend, held);
+		if (!held.empty()) {
+			DEBUG_LOG(("MTP Info: dc %1 holding %2 background requests."
+				).arg(_shiftedDcId
+				).arg(held.size()));
+			_sessionData->queueSendAnything(kHoldBackgroundRequests);
+		}
+
 		uint32 toSendCount = toSend.size();
 		if (pingRequest) ++toSendCount;
 		if (ackRequest) ++toSendCount;
@@ -739,7 +775,7 @@ void SessionPrivate::tryToSend() {
 		if (toSendCount == 1 && !first->forceSendInContainer) {
 			toSendRequest = first;
 			if (sendAll) {
-				toSend.clear();
+				toSend = std::move(held);
 				locker1.unlock();
 			}
 
@@ -904,7 +940,7 @@ void SessionPrivate::tryToSend() {
 					memcpy(toSendRequest->data() + from, request->constData() + 4, len * sizeof(mtpPrime));
 				}
 			}
-			toSend.clear();
+			toSend = std::move(held);
 
 			if (stateRequest) {
 				const auto msgId = placeToContainer(
@@ -1247,7 +1283,7 @@ void SessionPrivate::handleReceived() {
 		constexpr auto kMinimalEncryptedIntsCount = kEncryptedHeaderIntsCount + 4U; // + 1 data + 3 padding
 		constexpr auto kMinimalIntsCount = kExternalHeaderIntsCount + kMinimalEncryptedIntsCount;
 		auto intsCount = uint32(intsBuffer.size());
-		auto ints = intsBuffer.constData();
+		auto ints = intsBuffer.data();
 		if ((intsCount < kMinimalIntsCount) || (intsCount > kMaxMessageLength / kIntSize)) {
 			LOG(("TCP Error: bad message received, len %1").arg(intsCount * kIntSize));
 			return restart();
@@ -1263,12 +1299,12 @@ void SessionPrivate::handleReceived() {
 		auto encryptedInts = ints + kExternalHeaderIntsCount;
 		auto encryptedIntsCount = (intsCount - kExternalHeaderIntsCount) & ~0x03U;
 		auto encryptedBytesCount = encryptedIntsCount * kIntSize;
-		auto decryptedBuffer = QByteArray(encryptedBytesCount, Qt::Uninitialized);
 		auto msgKey = *(MTPint128*)(ints + 2);
 
-		aesIgeDecrypt(encryptedInts, decryptedBuffer.data(), encryptedBytesCount, _encryptionKey, msgKey);
+		// Decrypt in place, the received buffer is not used afterwards.
+		aesIgeDecrypt(encryptedInts, encryptedInts, encryptedBytesCount, _encryptionKey, msgKey);
 
-		auto decryptedInts = reinterpret_cast<const mtpPrime*>(decryptedBuffer.constData());
+		auto decryptedInts = static_cast<const mtpPrime*>(encryptedInts);
 		auto serverSalt = *(uint64*)&decryptedInts[0];
 		auto session = *(uint64*)&decryptedInts[2];
 		auto msgId = *(uint64*)&decryptedInts[4];
@@ -1805,6 +1841,7 @@ SessionPrivate::HandleResult SessionPrivate::handleOneReceived(
 		} else {
 			response.resize(end - from);
 			memcpy(response.data(), from, (end - from) * sizeof(mtpPrime));
+			CountCopiedBytes((end - from) * sizeof(mtpPrime));
 		}
 		if (typeId == mtpc_rpc_error) {
 			if (IsDestroyedTemporaryKeyError(response)) {
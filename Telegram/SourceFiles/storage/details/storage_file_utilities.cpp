@@ -16,6 +16,9 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <QtCore/QtEndian>
 #include <QtCore/QSaveFile>
 
+#include <future>
+#include <mutex>
+
 namespace Storage {
 namespace details {
 namespace {
@@ -25,11 +28,18 @@ constexpr auto TdfMagicLen = int(sizeof(TdfMagic));
 
 constexpr auto kStrongIterationsCount = 100'000;
 
+constexpr auto kJournalPostfix = 'j';
+constexpr auto kMaxJournalRecords = 256;
+constexpr auto kMinJournalCompactSize = int64(16 * 1024);
+constexpr auto kMaxJournalRecordSize = 64 * 1024 * 1024;
+
 struct WriteEntry {
 	QString basePath;
 	QString base;
 	QByteArray data;
 	QByteArray md5;
+	bool journal = false;
+	bool append = false;
 };
 
 class WriteManager final {
@@ -45,6 +55,7 @@ private:
 	void writeScheduled();
 	bool writeOneScheduledNow();
 	void writeNow(WriteEntry &&entry);
+	void writeJournalNow(WriteEntry &&entry);
 
 	template <typename File>
 	[[nodiscard]] bool open(File &file, const WriteEntry &entry, char postfix);
@@ -78,7 +89,16 @@ WriteManager::WriteManager(crl::weak_on_thread<WriteManager> weak)
 
 void WriteManager::write(WriteEntry &&entry) {
 	const auto i = ranges::find(_scheduled, entry.base, &WriteEntry::base);
-	if (i == end(_scheduled)) {
+	if (entry.journal) {
+		// Journal must be written after the base file it belongs to.
+		if (i != end(_scheduled) && entry.append) {
+			i->data.append(entry.data);
+			return;
+		} else if (i != end(_scheduled)) {
+			_scheduled.erase(i);
+		}
+		_scheduled.push_back(std::move(entry));
+	} else if (i == end(_scheduled)) {
 		_scheduled.push_back(std::move(entry));
 	} else {
 		*i = std::move(entry);
@@ -95,6 +115,10 @@ void WriteManager::writeSync(WriteEntry &&entry) {
 }
 
 void WriteManager::writeNow(WriteEntry &&entry) {
+	if (entry.journal) {
+		writeJournalNow(std::move(entry));
+		return;
+	}
 	const auto path = [&](char postfix) {
 		return this->path(entry, postfix);
 	};
@@ -135,6 +159,22 @@ void WriteManager::writeNow(WriteEntry &&entry) {
 	}
 }
 
+void WriteManager::writeJournalNow(WriteEntry &&entry) {
+	auto file = QFile(entry.base);
+	if (entry.append) {
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+			LOG(("Storage Error: Could not open '%1' for appending."
+				).arg(entry.base));
+			return;
+		}
+	} else if (!writeHeader(entry.basePath, file)) {
+		LOG(("Storage Error: Could not open '%1' for writing."
+			).arg(entry.base));
+		return;
+	}
+	file.write(entry.data);
+}
+
 void WriteManager::writeSyncAll() {
 	while (writeOneScheduledNow()) {
 	}
@@ -236,6 +276,198 @@ void AsyncWriteManager::stop() {
 
 AsyncWriteManager Manager;
 
+struct PreloadedFile {
+	QByteArray data;
+	int32 version = 0;
+	int position = 0;
+	MTP::AuthKeyPtr key;
+};
+
+using PreloadedFuture = std::future<std::optional<PreloadedFile>>;
+
+std::mutex PreloadedMutex;
+base::flat_map<QString, PreloadedFuture> Preloaded;
+
+[[nodiscard]] bool ReadFileNow(
+		FileReadDescriptor &result,
+		const QString &name,
+		const QString &basePath) {
+	const auto base = basePath + name;
+
+	// detect order of read attempts
+	QString toTry[2];
+	const auto modern = base + 's';
+	if (QFileInfo::exists(modern)) {
+		toTry[0] = modern;
+	} else {
+		// Legacy way.
+		toTry[0] = base + '0';
+		QFileInfo toTry0(toTry[0]);
+		if (toTry0.exists()) {
+			toTry[1] = basePath + name + '1';
+			QFileInfo toTry1(toTry[1]);
+			if (toTry1.exists()) {
+				QDateTime mod0 = toTry0.lastModified();
+				QDateTime mod1 = toTry1.lastModified();
+				if (mod0 < mod1) {
+					qSwap(toTry[0], toTry[1]);
+				}
+			} else {
+				toTry[1] = QString();
+			}
+		} else {
+			toTry[0][toTry[0].size() - 1] = '1';
+		}
+	}
+	for (int32 i = 0; i < 2; ++i) {
+		QString fname(toTry[i]);
+		if (fname.isEmpty()) break;
+
+		QFile f(fname);
+		if (!f.open(QIODevice::ReadOnly)) {
+			DEBUG_LOG(("App Info: failed to open '%1' for reading"
+				).arg(name));
+			continue;
+		}
+
+		// check magic
+		char magic[TdfMagicLen];
+		if (f.read(magic, TdfMagicLen) != TdfMagicLen) {
+			DEBUG_LOG(("App Info: failed to read magic from '%1'"
+				).arg(name));
+			continue;
+		}
+		if (memcmp(magic, TdfMagic, TdfMagicLen)) {
+			DEBUG_LOG(("App Info: bad magic %1 in '%2'").arg(
+				Logs::mb(magic, TdfMagicLen).str(),
+				name));
+			continue;
+		}
+
+		// read app version
+		qint32 version;
+		if (f.read((char*)&version, sizeof(version)) != sizeof(version)) {
+			DEBUG_LOG(("App Info: failed to read version from '%1'"
+				).arg(name));
+			continue;
+		}
+		if (version > AppVersion) {
+			DEBUG_LOG(("App Info: version too big %1 for '%2', my version %3"
+				).arg(version
+				).arg(name
+				).arg(AppVersion));
+//			continue;
+		}
+
+		// read data
+		QByteArray bytes = f.read(f.size());
+		int32 dataSize = bytes.size() - 16;
+		if (dataSize < 0) {
+			DEBUG_LOG(("App Info: bad file '%1', could not read sign part"
+				).arg(name));
+			continue;
+		}
+
+		// check signature
+		HashMd5 md5;
+		md5.feed(bytes.constData(), dataSize);
+		md5.feed(&dataSize, sizeof(dataSize));
+		md5.feed(&version, sizeof(version));
+		md5.feed(magic, TdfMagicLen);
+		if (memcmp(md5.result(), bytes.constData() + dataSize, 16)) {
+			DEBUG_LOG(("App Info: bad file '%1', signature did not match"
+				).arg(name));
+			continue;
+		}
+
+		bytes.resize(dataSize);
+		result.data = bytes;
+		bytes = QByteArray();
+
+		result.version = version;
+		result.buffer.setBuffer(&result.data);
+		result.buffer.open(QIODevice::ReadOnly);
+		result.stream.setDevice(&result.buffer);
+		result.stream.setVersion(QDataStream::Qt_5_1);
+
+		if ((i == 0 && !toTry[1].isEmpty()) || i == 1) {
+			QFile::remove(toTry[1 - i]);
+		}
+
+		return true;
+	}
+	return false;
+}
+
+[[nodiscard]] bool DecryptFile(
+		FileReadDescriptor &result,
+		const MTP::AuthKeyPtr &key) {
+	QByteArray encrypted;
+	result.stream >> encrypted;
+
+	EncryptedDescriptor data;
+	if (!DecryptLocal(data, encrypted, key)) {
+		result.stream.setDevice(nullptr);
+		if (result.buffer.isOpen()) result.buffer.close();
+		result.buffer.setBuffer(nullptr);
+		result.data = QByteArray();
+		result.version = 0;
+		return false;
+	}
+
+	result.stream.setDevice(0);
+	if (result.buffer.isOpen()) {
+		result.buffer.close();
+	}
+	result.buffer.setBuffer(0);
+	result.data = data.data;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(data.buffer.pos());
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+
+	return true;
+}
+
+void OpenPreloaded(FileReadDescriptor &result, PreloadedFile &&file) {
+	result.data = std::move(file.data);
+	result.version = file.version;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(file.position);
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+}
+
+[[nodiscard]] bool TakePreloaded(
+		FileReadDescriptor &result,
+		const QString &path,
+		const MTP::AuthKeyPtr &key) {
+	auto future = PreloadedFuture();
+	{
+		auto lock = std::unique_lock(PreloadedMutex);
+		const auto i = Preloaded.find(path);
+		if (i == end(Preloaded)) {
+			return false;
+		}
+		future = std::move(i->second);
+		Preloaded.erase(i);
+	}
+	auto file = future.get();
+	if (!file || file->key != key) {
+		// Let the caller read it once again to log the errors.
+		return false;
+	}
+	OpenPreloaded(result, std::move(*file));
+	return true;
+}
+
+void ForgetPreloaded(const QString &path) {
+	auto lock = std::unique_lock(PreloadedMutex);
+	Preloaded.remove(path);
+}
+
 } // namespace
 
 QString ToFilePart(FileKey val) {
@@ -280,6 +512,8 @@ FileKey GenerateKey(const QString &basePath) {
 }
 
 void ClearKey(const FileKey &key, const QString &basePath) {
+	ForgetPreloaded(basePath + ToFilePart(key));
+
 	QString name;
 	name.reserve(basePath.size() + 0x11);
 	name.append(basePath).append(ToFilePart(key)).append('0');
@@ -288,6 +522,8 @@ void ClearKey(const FileKey &key, const QString &basePath) {
 	QFile::remove(name);
 	name[name.size() - 1] = 's';
 	QFile::remove(name);
+	name[name.size() - 1] = kJournalPostfix;
+	QFile::remove(name);
 }
 
 bool CheckStreamStatus(QDataStream &stream) {
@@ -437,6 +673,7 @@ void FileWriteDescriptor::finish() {
 
 	_buffer.close();
 
+	ForgetPreloaded(_base);
 	auto entry = WriteEntry{
 		.basePath = _basePath,
 		.base = _base,
@@ -471,115 +708,41 @@ void FileWriteDescriptor::finish() {
 	return encrypted;
 }
 
-bool ReadFile(
-		FileReadDescriptor &result,
+void PreloadFile(
 		const QString &name,
-		const QString &basePath) {
-	const auto base = basePath + name;
-
-	// detect order of read attempts
-	QString toTry[2];
-	const auto modern = base + 's';
-	if (QFileInfo::exists(modern)) {
-		toTry[0] = modern;
-	} else {
-		// Legacy way.
-		toTry[0] = base + '0';
-		QFileInfo toTry0(toTry[0]);
-		if (toTry0.exists()) {
-			toTry[1] = basePath + name + '1';
-			QFileInfo toTry1(toTry[1]);
-			if (toTry1.exists()) {
-				QDateTime mod0 = toTry0.lastModified();
-				QDateTime mod1 = toTry1.lastModified();
-				if (mod0 < mod1) {
-					qSwap(toTry[0], toTry[1]);
-				}
-			} else {
-				toTry[1] = QString();
-			}
-		} else {
-			toTry[0][toTry[0].size() - 1] = '1';
-		}
-	}
-	for (int32 i = 0; i < 2; ++i) {
-		QString fname(toTry[i]);
-		if (fname.isEmpty()) break;
-
-		QFile f(fname);
-		if (!f.open(QIODevice::ReadOnly)) {
-			DEBUG_LOG(("App Info: failed to open '%1' for reading"
-				).arg(name));
-			continue;
-		}
-
-		// check magic
-		char magic[TdfMagicLen];
-		if (f.read(magic, TdfMagicLen) != TdfMagicLen) {
-			DEBUG_LOG(("App Info: failed to read magic from '%1'"
-				).arg(name));
-			continue;
-		}
-		if (memcmp(magic, TdfMagic, TdfMagicLen)) {
-			DEBUG_LOG(("App Info: bad magic %1 in '%2'").arg(
-				Logs::mb(magic, TdfMagicLen).str(),
-				name));
-			continue;
-		}
-
-		// read app version
-		qint32 version;
-		if (f.read((char*)&version, sizeof(version)) != sizeof(version)) {
-			DEBUG_LOG(("App Info: failed to read version from '%1'"
-				).arg(name));
-			continue;
-		}
-		if (version > AppVersion) {
-			DEBUG_LOG(("App Info: version too big %1 for '%2', my version %3"
-				).arg(version
-				).arg(name
-				).arg(AppVersion));
-//			continue;
-		}
-
-		// read data
-		QByteArray bytes = f.read(f.size());
-		int32 dataSize = bytes.size() - 16;
-		if (dataSize < 0) {
-			DEBUG_LOG(("App Info: bad file '%1', could not read sign part"
-				).arg(name));
-			continue;
-		}
-
-		// check signature
-		HashMd5 md5;
-		md5.feed(bytes.constData(), dataSize);
-		md5.feed(&dataSize, sizeof(dataSize));
-		md5.feed(&version, sizeof(version));
-		md5.feed(magic, TdfMagicLen);
-		if (memcmp(md5.result(), bytes.constData() + dataSize, 16)) {
-			DEBUG_LOG(("App Info: bad file '%1', signature did not match"
-				).arg(name));
-			continue;
+		const QString &basePath,
+		const MTP::AuthKeyPtr &key) {
+	auto promise = std::make_shared<std::promise<std::optional<PreloadedFile>>>();
+	{
+		auto lock = std::unique_lock(PreloadedMutex);
+		Preloaded[basePath + name] = promise->get_future();
+	}
+	crl::async([=] {
+		auto file = FileReadDescriptor();
+		auto result = std::optional<PreloadedFile>();
+		if (ReadFileNow(file, name, basePath)
+			&& (!key || DecryptFile(file, key))) {
+			result = PreloadedFile{
+				.data = file.data,
+				.version = file.version,
+				.position = int(file.buffer.pos()),
+				.key = key,
+			};
 		}
+		promise->set_value(std::move(result));
+	});
+}
 
-		bytes.resize(dataSize);
-		result.data = bytes;
-		bytes = QByteArray();
-
-		result.version = version;
-		result.buffer.setBuffer(&result.data);
-		result.buffer.open(QIODevice::ReadOnly);
-		result.stream.setDevice(&result.buffer);
-		result.stream.setVersion(QDataStream::Qt_5_1);
-
-		if ((i == 0 && !toTry[1].isEmpty()) || i == 1) {
-			QFile::remove(toTry[1 - i]);
-		}
+void ForgetPreloadedFile(const QString &name, const QString &basePath) {
+	ForgetPreloaded(basePath + name);
+}
 
-		return true;
-	}
-	return false;
+bool ReadFile(
+		FileReadDescriptor &result,
+		const QString &name,
+		const QString &basePath) {
+	return TakePreloaded(result, basePath + name, nullptr)
+		|| ReadFileNow(result, name, basePath);
 }
 
 bool DecryptLocal(
@@ -626,35 +789,10 @@ bool ReadEncryptedFile(
 		const QString &name,
 		const QString &basePath,
 		const MTP::AuthKeyPtr &key) {
-	if (!ReadFile(result, name, basePath)) {
-		return false;
-	}
-	QByteArray encrypted;
-	result.stream >> encrypted;
-
-	EncryptedDescriptor data;
-	if (!DecryptLocal(data, encrypted, key)) {
-		result.stream.setDevice(nullptr);
-		if (result.buffer.isOpen()) result.buffer.close();
-		result.buffer.setBuffer(nullptr);
-		result.data = QByteArray();
-		result.version = 0;
-		return false;
-	}
-
-	result.stream.setDevice(0);
-	if (result.buffer.isOpen()) {
-		result.buffer.close();
+	if (TakePreloaded(result, basePath + name, key)) {
+		return true;
 	}
-	result.buffer.setBuffer(0);
-	result.data = data.data;
-	result.buffer.setBuffer(&result.data);
-	result.buffer.open(QIODevice::ReadOnly);
-	result.buffer.seek(data.buffer.pos());
-	result.stream.setDevice(&result.buffer);
-	result.stream.setVersion(QDataStream::Qt_5_1);
-
-	return true;
+	return ReadFile(result, name, basePath) && DecryptFile(result, key);
 }
 
 bool ReadEncryptedFile(
@@ -665,12 +803,153 @@ bool ReadEncryptedFile(
 	return ReadEncryptedFile(result, ToFilePart(fkey), basePath, key);
 }
 
+bool JournalState::canAppend(int64 recordSize) const {
+	return generation
+		&& (records < kMaxJournalRecords)
+		&& (size + recordSize <= std::max(baseSize, kMinJournalCompactSize));
+}
+
+uint64 NewJournalGeneration() {
+	auto result = uint64();
+	while (!result) {
+		result = base::RandomValue<uint64>();
+	}
+	return result;
+}
+
+void StartJournal(
+		const QString &name,
+		const QString &basePath,
+		JournalState &state,
+		uint64 generation,
+		int64 baseSize) {
+	Expects(generation != 0);
+
+	state = JournalState{
+		.generation = generation,
+		.baseSize = baseSize,
+	};
+	auto data = QByteArray(sizeof(generation), Qt::Uninitialized);
+	memcpy(data.data(), &generation, sizeof(generation));
+	Manager.write({
+		.basePath = basePath,
+		.base = basePath + name + kJournalPostfix,
+		.data = std::move(data),
+		.journal = true,
+	});
+}
+
+void AppendToJournal(
+		const QString &name,
+		const QString &basePath,
+		JournalState &state,
+		EncryptedDescriptor &record,
+		const MTP::AuthKeyPtr &key) {
+	Expects(state.generation != 0);
+
+	const auto encrypted = PrepareEncrypted(record, key);
+	const auto size = quint32(encrypted.size());
+	auto data = QByteArray();
+	data.reserve(sizeof(size) + encrypted.size());
+	data.append(reinterpret_cast<const char*>(&size), sizeof(size));
+	data.append(encrypted);
+	state.size += data.size();
+	++state.records;
+	Manager.write({
+		.basePath = basePath,
+		.base = basePath + name + kJournalPostfix,
+		.data = std::move(data),
+		.journal = true,
+		.append = true,
+	});
+}
+
+void ClearJournal(
+		const QString &name,
+		const QString &basePath,
+		JournalState &state) {
+	state = JournalState();
+	QFile::remove(basePath + name + kJournalPostfix);
+}
+
+void ReadJournal(
+		const QString &name,
+		const QString &basePath,
+		JournalState &state,
+		const MTP::AuthKeyPtr &key,
+		FnMut<bool(EncryptedDescriptor &record, int32 version)> apply) {
+	const auto generation = state.generation;
+	const auto baseSize = state.baseSize;
+	state = JournalState();
+	if (!generation) {
+		return;
+	}
+	auto file = QFile(basePath + name + kJournalPostfix);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	const auto bytes = file.readAll();
+	const auto header = TdfMagicLen + int(sizeof(qint32) + sizeof(uint64));
+	if (bytes.size() < header || memcmp(bytes.constData(), TdfMagic, TdfMagicLen)) {
+		DEBUG_LOG(("App Info: bad journal '%1'").arg(name));
+		return;
+	}
+	auto version = qint32();
+	auto written = uint64();
+	memcpy(&version, bytes.constData() + TdfMagicLen, sizeof(version));
+	memcpy(
+		&written,
+		bytes.constData() + TdfMagicLen + sizeof(version),
+		sizeof(written));
+	if (written != generation) {
+		DEBUG_LOG(("App Info: stale journal '%1'").arg(name));
+		return;
+	}
+	state = JournalState{
+		.generation = generation,
+		.baseSize = baseSize,
+	};
+	auto offset = header;
+	while (bytes.size() - offset >= int(sizeof(quint32))) {
+		auto size = quint32();
+		memcpy(&size, bytes.constData() + offset, sizeof(size));
+		if (size > kMaxJournalRecordSize
+			|| bytes.size() - offset - int(sizeof(size)) < int(size)) {
+			// Record was not written completely.
+			break;
+		}
+		auto record = EncryptedDescriptor();
+		const auto encrypted = QByteArray::fromRawData(
+			bytes.constData() + offset + sizeof(size),
+			size);
+		if (!DecryptLocal(record, encrypted, key)
+			|| !apply(record, version)) {
+			break;
+		}
+		offset += sizeof(size) + size;
+		state.size += sizeof(size) + size;
+		++state.records;
+	}
+	if (offset != bytes.size()) {
+		LOG(("App Info: journal '%1' read %2 of %3 bytes."
+			).arg(name
+			).arg(offset
+			).arg(bytes.size()));
+
+		// Records appended after a broken one won't be read, compact instead.
+		state.records = kMaxJournalRecords;
+	}
+}
+
 void Sync() {
 	Manager.sync();
 }
 
 void Finish() {
 	Manager.stop();
+
+	auto lock = std::unique_lock(PreloadedMutex);
+	Preloaded.clear();
 }
 
 } // namespace details
@@ -84,6 +84,17 @@ private:
 
 };
 
+// Reads and checks the file (and decrypts it, if the key is provided) on a
+// background thread. The following ReadFile() or ReadEncryptedFile() call
+// takes the result, waiting for it if it is not ready yet.
+void PreloadFile(
+	const QString &name,
+	const QString &basePath,
+	const MTP::AuthKeyPtr &key = nullptr);
+
+// Frees the result of PreloadFile() if no read has taken it.
+void ForgetPreloadedFile(const QString &name, const QString &basePath);
+
 bool ReadFile(
 	FileReadDescriptor &result,
 	const QString &name,
@@ -106,6 +117,48 @@ bool ReadEncryptedFile(
 	const QString &basePath,
 	const MTP::AuthKeyPtr &key);
 
+// Small changes of a file may be appended to its journal ('j' postfix)
+// instead of rewriting the whole file. Each record is encrypted on its
+// own, so a record cut by a crash is skipped on read. The base file must
+// keep the generation of its journal, journals of other generations are
+// left over from before the last full rewrite and are ignored.
+struct JournalState {
+	uint64 generation = 0;
+	int64 baseSize = 0;
+	int64 size = 0;
+	int records = 0;
+
+	[[nodiscard]] bool canAppend(int64 recordSize) const;
+};
+
+[[nodiscard]] uint64 NewJournalGeneration();
+
+// Should be called right after the base file with this generation is written.
+void StartJournal(
+	const QString &name,
+	const QString &basePath,
+	JournalState &state,
+	uint64 generation,
+	int64 baseSize);
+void AppendToJournal(
+	const QString &name,
+	const QString &basePath,
+	JournalState &state,
+	EncryptedDescriptor &record,
+	const MTP::AuthKeyPtr &key);
+void ClearJournal(
+	const QString &name,
+	const QString &basePath,
+	JournalState &state);
+
+// Expects state.generation and state.baseSize read from the base file.
+void ReadJournal(
+	const QString &name,
+	const QString &basePath,
+	JournalState &state,
+	const MTP::AuthKeyPtr &key,
+	FnMut<bool(EncryptedDescriptor &record, int32 version)> apply);
+
 void Sync();
 void Finish();
 
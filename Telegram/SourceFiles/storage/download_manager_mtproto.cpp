@@ -20,8 +20,12 @@ namespace Storage {
 namespace {
 
 constexpr auto kKillSessionTimeout = 15 * crl::time(1000);
-constexpr auto kStartWaitedInSession = 4 * kDownloadPartSize;
+constexpr auto kMinWaitedInSession = 4 * kMinAdaptivePartSize;
 constexpr auto kMaxWaitedInSession = 16 * kDownloadPartSize;
+constexpr auto kMaxPartsInSession = 16;
+constexpr auto kAdaptivePartsInWindow = 4;
+constexpr auto kWindowRoundTrips = 2;
+constexpr auto kRoundTripResetSamples = 64;
 constexpr auto kStartSessionsCount = 1;
 constexpr auto kMaxSessionsCount = 8;
 constexpr auto kMaxTrackedSessionRemoves = 64;
@@ -38,6 +42,10 @@ constexpr auto kBadRequestDurationThreshold = 8 * crl::time(1000);
 // and for successes in all remaining sessions:
 // kRetryAddSessionSuccesses * max(removesCount, kMaxTrackedSessionRemoves)
 
+// Each session keeps up to kWindowRoundTrips bandwidth-delay products
+// in flight, where bandwidth is estimated as the amount requested before
+// a request divided by its duration and delay is the minimal duration.
+
 } // namespace
 
 void DownloadManagerMtproto::Queue::enqueue(
@@ -180,23 +188,26 @@ void DownloadManagerMtproto::checkSendNextAfterSuccess(MTP::DcId dcId) {
 bool DownloadManagerMtproto::trySendNextPart(MTP::DcId dcId, Queue &queue) {
 	auto &balanceData = _balanceData[dcId];
 	const auto &sessions = balanceData.sessions;
+	const auto partSize = chooseAdaptivePartSize(dcId);
+	const auto canRequest = [&](const DcSessionBalanceData &data) {
+		return (data.requested + partSize <= data.maxWaitedAmount)
+			&& (data.requestedParts < kMaxPartsInSession);
+	};
 	const auto bestIndex = [&] {
-		const auto proj = [](const DcSessionBalanceData &data) {
-			return (data.requested < data.maxWaitedAmount)
+		const auto proj = [&](const DcSessionBalanceData &data) {
+			return canRequest(data)
 				? data.requested
-				: 16 * cNetDownloadChunkSize();
+				: std::numeric_limits<int>::max();
 		};
 		const auto j = ranges::min_element(sessions, ranges::less(), proj);
-		return (j->requested + cNetDownloadChunkSize() <= j->maxWaitedAmount)
-			? (j - begin(sessions))
-			: -1;
+		return canRequest(*j) ? (j - begin(sessions)) : -1;
 	}();
 	if (bestIndex < 0) {
 		return false;
 	}
 	const auto onlyHighestPriority = (balanceData.totalRequested > 0);
 	if (const auto task = queue.nextTask(onlyHighestPriority)) {
-		task->loadPart(bestIndex);
+		task->loadPart(bestIndex, partSize);
 		return true;
 	}
 	return false;
@@ -209,7 +220,9 @@ int DownloadManagerMtproto::changeRequestedAmount(
 	const auto i = _balanceData.find(dcId);
 	Assert(i != _balanceData.end());
 	Assert(index < i->second.sessions.size());
-	const auto result = (i->second.sessions[index].requested += delta);
+	auto &session = i->second.sessions[index];
+	const auto result = (session.requested += delta);
+	session.requestedParts += (delta > 0) ? 1 : -1;
 	i->second.totalRequested += delta;
 	const auto findNonEmptySession = [](const DcBalanceData &data) {
 		using namespace rpl::mappers;
@@ -240,13 +253,12 @@ void DownloadManagerMtproto::requestSucceeded(
 	auto &data = dc.sessions[index];
 	const auto overloaded = (timeAtRequestStart <= dc.lastSessionRemove)
 		|| (amountAtRequestStart > data.maxWaitedAmount);
-	const auto parts = amountAtRequestStart / cNetDownloadChunkSize();
 	const auto duration = (crl::now() - timeAtRequestStart);
-	DEBUG_LOG(("Download (%1,%2) request done, duration: %3, parts: %4%5"
+	DEBUG_LOG(("Download (%1,%2) request done, duration: %3, amount: %4%5"
 		).arg(dcId
 		).arg(index
 		).arg(duration
-		).arg(parts
+		).arg(amountAtRequestStart
 		).arg(overloaded ? " (overloaded)" : ""));
 	if (overloaded) {
 		return;
@@ -259,16 +271,7 @@ void DownloadManagerMtproto::requestSucceeded(
 		});
 		return;
 	}
-	if (amountAtRequestStart == data.maxWaitedAmount
-		&& data.maxWaitedAmount < (16 * cNetDownloadChunkSize())) {
-		data.maxWaitedAmount = std::min(
-			data.maxWaitedAmount + cNetDownloadChunkSize(),
-			16 * cNetDownloadChunkSize());
-		DEBUG_LOG(("Download (%1,%2) increased max waited amount %3."
-			).arg(dcId
-			).arg(index
-			).arg(data.maxWaitedAmount));
-	}
+	updateSessionEstimates(dcId, data, amountAtRequestStart, duration);
 	data.successes = std::min(data.successes + 1, kMaxTrackedSuccesses);
 	const auto notEnough = ranges::any_of(
 		dc.sessions,
@@ -298,6 +301,100 @@ void DownloadManagerMtproto::requestSucceeded(
 		).arg(dc.sessions.size()));
 }
 
+void DownloadManagerMtproto::updateSessionEstimates(
+		MTP::DcId dcId,
+		DcSessionBalanceData &data,
+		int amountAtRequestStart,
+		crl::time duration) {
+	duration = std::max(duration, crl::time(1));
+	const auto rate = int64(amountAtRequestStart) * 1000 / duration;
+	data.bytesPerSecond = data.bytesPerSecond
+		? ((data.bytesPerSecond * 3 + rate) / 4)
+		: rate;
+	if (!data.roundTrip
+		|| duration < data.roundTrip
+		|| ++data.roundTripSamples >= kRoundTripResetSamples) {
+		data.roundTrip = duration;
+		data.roundTripSamples = 0;
+	}
+
+	const auto product = data.bytesPerSecond * data.roundTrip / 1000;
+	const auto target = int(std::clamp(
+		product * kWindowRoundTrips,
+		int64(kMinWaitedInSession),
+		int64(kMaxWaitedInSession)));
+	const auto was = data.maxWaitedAmount;
+	const auto step = cNetDownloadChunkSize();
+	if (target > was && amountAtRequestStart + step > was) {
+		data.maxWaitedAmount = std::min(was + step, target);
+	} else if (target < was) {
+		data.maxWaitedAmount = std::max(was - step, target);
+	}
+	if (data.maxWaitedAmount != was) {
+		const auto stats = dcStats(dcId);
+		DEBUG_LOG(("Download (%1) changed max waited amount %2, "
+			"speed: %3, round trip: %4. "
+			"DC sessions: %5, speed: %6, round trip: %7, "
+			"part size: %8, requested: %9."
+			).arg(dcId
+			).arg(data.maxWaitedAmount
+			).arg(data.bytesPerSecond
+			).arg(data.roundTrip
+			).arg(stats.sessions
+			).arg(stats.bytesPerSecond
+			).arg(stats.roundTrip
+			).arg(stats.partSize
+			).arg(stats.requested));
+	}
+}
+
+int DownloadManagerMtproto::chooseAdaptivePartSize(MTP::DcId dcId) const {
+	const auto i = _balanceData.find(dcId);
+	if (i == end(_balanceData)) {
+		return cNetDownloadChunkSize();
+	}
+	auto window = int64();
+	auto measured = 0;
+	for (const auto &session : i->second.sessions) {
+		if (session.bytesPerSecond > 0) {
+			window += session.maxWaitedAmount;
+			++measured;
+		}
+	}
+	if (!measured) {
+		return cNetDownloadChunkSize();
+	}
+	const auto perSession = window / measured;
+	auto result = kDownloadPartSize;
+	while (result > kMinAdaptivePartSize
+		&& result * kAdaptivePartsInWindow > perSession) {
+		result /= 2;
+	}
+	return result;
+}
+
+auto DownloadManagerMtproto::dcStats(MTP::DcId dcId) const -> DcStats {
+	const auto i = _balanceData.find(dcId);
+	if (i == end(_balanceData)) {
+		return {};
+	}
+	auto result = DcStats{
+		.sessions = int(i->second.sessions.size()),
+		.partSize = chooseAdaptivePartSize(dcId),
+		.requested = i->second.totalRequested,
+	};
+	for (const auto &session : i->second.sessions) {
+		if (!session.roundTrip) {
+			continue;
+		}
+		result.bytesPerSecond += session.bytesPerSecond;
+		if (!result.roundTrip || session.roundTrip < result.roundTrip) {
+			result.roundTrip = session.roundTrip;
+		}
+	}
+	return result;
+}
+
 int DownloadManagerMtproto::chooseSessionIndex(MTP::DcId dcId) const {
 	const auto i = _balanceData.find(dcId);
 	Assert(i != end(_balanceData));
@@ -350,9 +447,9 @@ void DownloadManagerMtproto::removeSession(MTP::DcId dcId) {
 	auto &session = dc.sessions.back();
 
 	// Make sure we don't send anything to that session while redirecting.
-	session.requested += (16 * cNetDownloadChunkSize()) * kMaxSessionsCount;
+	session.requested += kMaxWaitedInSession;
 	queue.removeSession(index);
-	Assert(session.requested == (16 * cNetDownloadChunkSize()) * kMaxSessionsCount);
+	Assert(session.requested == kMaxWaitedInSession);
 
 	dc.sessions.pop_back();
 	api().instance().killSession(MTP::downloadDcId(dcId, index));
@@ -475,20 +572,50 @@ void DownloadMtprotoTask::refreshFileReferenceFrom(
 	}
 }
 
-void DownloadMtprotoTask::loadPart(int sessionIndex) {
-	makeRequest({ takeNextRequestOffset(), sessionIndex });
+void DownloadMtprotoTask::loadPart(int sessionIndex, int adaptivePartSize) {
+	const auto preferred = (_servedWithoutCdn && !_cdnDcId)
+		? adaptivePartSize
+		: cNetDownloadChunkSize();
+	const auto part = takeNextRequest(preferred);
+	makeRequest({ part.offset, sessionIndex, part.limit });
+}
+
+auto DownloadMtprotoTask::takeNextRequest(int preferredLimit)
+-> PartRequest {
+	return { takeNextRequestOffset(), cNetDownloadChunkSize() };
+}
+
+int DownloadMtprotoTask::AlignedPartSize(int64 offset, int preferred) {
+	// upload.getFile requires 1MB to be divisible by the limit and
+	// the requested range not to cross a 1MB boundary.
+	auto result = std::clamp(
+		preferred,
+		kMinAdaptivePartSize,
+		kDownloadPartSize);
+	while (result & (result - 1)) {
+		result &= (result - 1);
+	}
+	while (result > kMinAdaptivePartSize && (offset % result) != 0) {
+		result /= 2;
+	}
+	return result;
 }
 
 void DownloadMtprotoTask::removeSession(int sessionIndex) {
 	struct Redirect {
 		mtpRequestId requestId = 0;
 		int64 offset = 0;
+		int limit = 0;
 	};
 	auto redirect = std::vector<Redirect>();
 	for (const auto &[requestId, requestData] : _sentRequests) {
 		if (requestData.sessionIndex == sessionIndex) {
 			redirect.reserve(_sentRequests.size());
-			redirect.push_back({ requestId, requestData.offset });
+			redirect.push_back({
+				requestId,
+				requestData.offset,
+				requestData.limit,
+			});
 		}
 	}
 	for (auto &[requestData, bytes] : _cdnUncheckedParts) {
@@ -498,13 +625,13 @@ void DownloadMtprotoTask::removeSession(int sessionIndex) {
 			requestData.sessionIndex = newIndex;
 		}
 	}
-	for (const auto &[requestId, offset] : redirect) {
+	for (const auto &[requestId, offset, limit] : redirect) {
 		const auto needMakeRequest = (requestId != _cdnHashesRequestId);
 		cancelRequest(requestId);
 		if (needMakeRequest) {
 			const auto newIndex = _owner->chooseSessionIndex(dcId());
 			Assert(newIndex < sessionIndex);
-			makeRequest({ offset, newIndex });
+			makeRequest({ offset, newIndex, limit });
 		}
 	}
 }
@@ -512,7 +639,7 @@ void DownloadMtprotoTask::removeSession(int sessionIndex) {
 mtpRequestId DownloadMtprotoTask::sendRequest(
 		const RequestData &requestData) {
 	const auto offset = requestData.offset;
-	const auto limit = cNetDownloadChunkSize();
+	const auto limit = requestData.limit;
 	const auto shiftedDcId = MTP::downloadDcId(
 		_cdnDcId ? _cdnDcId : dcId(),
 		requestData.sessionIndex);
@@ -595,6 +722,17 @@ bool DownloadMtprotoTask::setWebFileSizeHook(int64 size) {
 }
 
 void DownloadMtprotoTask::makeRequest(const RequestData &requestData) {
+	const auto chunk = cNetDownloadChunkSize();
+	if (_cdnDcId && requestData.limit > chunk) {
+		// CDN file hashes are checked only for fixed size parts.
+		auto part = requestData;
+		part.limit = chunk;
+		for (auto i = 0; i != requestData.limit / chunk; ++i) {
+			makeRequest(part);
+			part.offset += chunk;
+		}
+		return;
+	}
 	placeSentRequest(sendRequest(requestData), requestData);
 }
 
@@ -629,6 +767,7 @@ void DownloadMtprotoTask::normalPartLoaded(
 	result.match([&](const MTPDupload_fileCdnRedirect &data) {
 		switchToCDN(requestData, data);
 	}, [&](const MTPDupload_file &data) {
+		_servedWithoutCdn = true;
 		partLoaded(requestData.offset, data.vbytes().v);
 	});
 
@@ -803,7 +942,7 @@ void DownloadMtprotoTask::placeSentRequest(
 	const auto amount = _owner->changeRequestedAmount(
 		dcId(),
 		requestData.sessionIndex,
-		cNetDownloadChunkSize());
+		requestData.limit);
 	const auto [i, ok1] = _sentRequests.emplace(requestId, requestData);
 	const auto [j, ok2] = _requestByOffset.emplace(
 		requestData.offset,
@@ -829,7 +968,7 @@ auto DownloadMtprotoTask::finishSentRequest(
 	_owner->changeRequestedAmount(
 		dcId(),
 		result.sessionIndex,
-		-cNetDownloadChunkSize());
+		-result.limit);
 	_sentRequests.erase(it);
 	const auto ok = _requestByOffset.remove(result.offset);
 
@@ -19,11 +19,12 @@ class Error;
 
 namespace Storage {
 
-// Different part sizes are not supported for now :(
-// Because we start downloading with some part size
-// and then we get a CDN-redirect where we support only
-// fixed part size download for hash checking.
+// Streaming and CDN downloads use fixed part sizes, because CDN file
+// hashes are checked per part and streaming slices store parts by index.
+// Plain sequential file downloads may switch to any power of two part
+// size between kMinAdaptivePartSize and kDownloadPartSize.
 constexpr auto kDownloadPartSize = 1024 * 1024;
+constexpr auto kMinAdaptivePartSize = 128 * 1024;
 
 class DownloadMtprotoTask;
 
@@ -56,6 +57,7 @@ public:
 		crl::time timeAtRequestStart);
 	void checkSendNextAfterSuccess(MTP::DcId dcId);
 	[[nodiscard]] int chooseSessionIndex(MTP::DcId dcId) const;
+	[[nodiscard]] int chooseAdaptivePartSize(MTP::DcId dcId) const;
 
 private:
 	class Queue final {
@@ -79,8 +81,14 @@ private:
 		DcSessionBalanceData();
 
 		int requested = 0;
+		int requestedParts = 0;
 		int successes = 0; // Since last timeout in this dc in any session.
 		int maxWaitedAmount = 0;
+
+		// Estimated from the finished requests, zero until measured.
+		int64 bytesPerSecond = 0;
+		crl::time roundTrip = 0;
+		int roundTripSamples = 0;
 	};
 	struct DcBalanceData {
 		DcBalanceData();
@@ -92,6 +100,13 @@ private:
 		int timeouts = 0; // Since all sessions had successes >= required.
 		int totalRequested = 0;
 	};
+	struct DcStats {
+		int sessions = 0;
+		int64 bytesPerSecond = 0;
+		crl::time roundTrip = 0;
+		int partSize = 0;
+		int requested = 0;
+	};
 
 	void checkSendNext();
 	void checkSendNext(MTP::DcId dcId, Queue &queue);
@@ -105,6 +120,12 @@ private:
 	void resetGeneration();
 	void sessionTimedOut(MTP::DcId dcId, int index);
 	void removeSession(MTP::DcId dcId);
+	void updateSessionEstimates(
+		MTP::DcId dcId,
+		DcSessionBalanceData &data,
+		int amountAtRequestStart,
+		crl::time duration);
+	[[nodiscard]] DcStats dcStats(MTP::DcId dcId) const;
 
 	const not_null<ApiWrap*> _api;
 
@@ -147,7 +168,7 @@ public:
 	[[nodiscard]] const Location &location() const;
 
 	[[nodiscard]] virtual bool readyToRequest() const = 0;
-	void loadPart(int sessionIndex);
+	void loadPart(int sessionIndex, int adaptivePartSize);
 	void removeSession(int sessionIndex);
 
 	void refreshFileReferenceFrom(
@@ -156,6 +177,11 @@ public:
 		const QByteArray &current);
 
 protected:
+	struct PartRequest {
+		int64 offset = 0;
+		int limit = 0;
+	};
+
 	[[nodiscard]] bool haveSentRequests() const;
 	[[nodiscard]] bool haveSentRequestForOffset(int64 offset) const;
 	void cancelAllRequests();
@@ -168,10 +194,13 @@ protected:
 		return _owner->api();
 	}
 
+	[[nodiscard]] static int AlignedPartSize(int64 offset, int preferred);
+
 private:
 	struct RequestData {
 		int64 offset = 0;
 		mutable int sessionIndex = 0;
+		int limit = 0;
 		int requestedInSession = 0;
 		crl::time sent = 0;
 
@@ -198,6 +227,10 @@ private:
 
 	// Called only if readyToRequest() == true.
 	[[nodiscard]] virtual int64 takeNextRequestOffset() = 0;
+
+	// Tasks that write parts sequentially may accept any limit that
+	// AlignedPartSize() allows, others use the fixed download part size.
+	[[nodiscard]] virtual PartRequest takeNextRequest(int preferredLimit);
 	virtual bool feedPart(int64 offset, const QByteArray &bytes) = 0;
 	virtual bool setWebFileSizeHook(int64 size);
 	virtual void cancelOnFail() = 0;
@@ -271,6 +304,9 @@ private:
 	base::flat_map<RequestData, QByteArray> _cdnUncheckedParts;
 	mtpRequestId _cdnHashesRequestId = 0;
 
+	// Set after the first part was received without a CDN redirect.
+	bool _servedWithoutCdn = false;
+
 };
 
 } // namespace Storage
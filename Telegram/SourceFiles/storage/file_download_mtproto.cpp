@@ -135,10 +135,15 @@ bool mtpFileLoader::readyToRequest() const {
 }
 
 int64 mtpFileLoader::takeNextRequestOffset() {
+	return takeNextRequest(cNetDownloadChunkSize()).offset;
+}
+
+auto mtpFileLoader::takeNextRequest(int preferredLimit) -> PartRequest {
 	Expects(readyToRequest());
 
-	const auto result = _nextRequestOffset;
-	_nextRequestOffset += cNetDownloadChunkSize();
+	const auto limit = AlignedPartSize(_nextRequestOffset, preferredLimit);
+	const auto result = PartRequest{ _nextRequestOffset, limit };
+	_nextRequestOffset += limit;
 	return result;
 }
 
@@ -26,8 +26,17 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 namespace Storage {
 namespace {
 
-// max 512kb uploaded at the same time in each session
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024;
+// Each session starts with 512kb in flight and grows it up to 2mb while
+// the part acknowledgments come without additional latency.
+constexpr auto kMinSessionWindow = int64(512 * 1024);
+constexpr auto kMaxSessionWindow = int64(2 * 1024 * 1024);
+constexpr auto kWindowGrowLatencyFactor = 2;
+
+// Several files are uploaded at the same time, sharing the sessions.
+constexpr auto kUploadFilesInParallel = 3;
+
+// Parts of each document are read from disk ahead on a background thread.
+constexpr auto kReadAheadParts = 4;
 
 constexpr auto kDocumentMaxPartsCountDefault = 4000;
 
@@ -75,14 +84,35 @@ struct Uploader::File {
 	uint64 thumbId() const;
 	const QString &filename() const;
 
+	[[nodiscard]] UploadFileParts &parts();
+	[[nodiscard]] uint64 partsOfId() const;
+	[[nodiscard]] QByteArray &content();
+	[[nodiscard]] const QString &filepath() const;
+	[[nodiscard]] int64 nextPartSize();
+
 	HashMd5 md5Hash;
 
-	std::unique_ptr<QFile> docFile;
 	int64 docSize = 0;
 	int64 docPartSize = 0;
 	int docSentParts = 0;
 	int docPartsCount = 0;
 
+	std::shared_ptr<FileReader> docReader;
+	std::deque<QByteArray> docReadParts;
+	int docReadPartsCount = 0;
+	bool docReading = false;
+
+	int requests = 0;
+	int docRequests = 0;
+	int64 requestsSize = 0;
+	bool started = false;
+
+};
+
+struct Uploader::FileReader {
+	QFile file;
+	HashMd5 md5Hash;
+	bool hash = false;
 };
 
 Uploader::File::File(const SendMediaReady &media) : media(media) {
@@ -158,6 +188,41 @@ const QString &Uploader::File::filename() const {
 	return file ? file->filename : media.filename;
 }
 
+UploadFileParts &Uploader::File::parts() {
+	return file
+		? ((type() == SendMediaType::Photo || type() == SendMediaType::Secure)
+			? file->fileparts
+			: file->thumbparts)
+		: media.parts;
+}
+
+uint64 Uploader::File::partsOfId() const {
+	return file
+		? ((type() == SendMediaType::Photo || type() == SendMediaType::Secure)
+			? file->id
+			: file->thumbId)
+		: media.thumbId;
+}
+
+QByteArray &Uploader::File::content() {
+	return file ? file->content : media.data;
+}
+
+const QString &Uploader::File::filepath() const {
+	return file ? file->filepath : media.file;
+}
+
+int64 Uploader::File::nextPartSize() {
+	if (!parts().isEmpty()) {
+		return parts().begin().value().size();
+	} else if (docSentParts >= docPartsCount) {
+		return 0;
+	} else if (!content().isEmpty()) {
+		return docPartSize;
+	}
+	return docReadParts.empty() ? 0 : docReadParts.front().size();
+}
+
 Uploader::Uploader(not_null<ApiWrap*> api)
 : _api(api)
 , _nextTimer([=] { sendNext(); })
@@ -214,6 +279,8 @@ Uploader::Uploader(not_null<ApiWrap*> api)
 	) | rpl::start_with_next([=](const FullMsgId &fullId) {
 		processDocumentFailed(fullId);
 	}, _lifetime);
+
+	resetSessionWindows();
 }
 
 void Uploader::processPhotoProgress(const FullMsgId &newId) {
@@ -283,6 +350,10 @@ Main::Session &Uploader::session() const {
 	return _api->session();
 }
 
+FullMsgId Uploader::currentUploadId() const {
+	return queue.empty() ? FullMsgId() : queue.begin()->first;
+}
+
 void Uploader::uploadMedia(
 		const FullMsgId &msgId,
 		const SendMediaReady &media) {
@@ -364,22 +435,16 @@ void Uploader::upload(
 	sendNext();
 }
 
-void Uploader::currentFailed() {
-	auto j = queue.find(uploadingId);
+void Uploader::fileFailed(const FullMsgId &itemId) {
+	cancelRequests(itemId);
+
+	auto j = queue.find(itemId);
 	if (j != queue.end()) {
 		const auto [msgId, file] = std::move(*j);
 		queue.erase(j);
 		notifyFailed(msgId, file);
 	}
 
-	cancelRequests();
-	dcMap.clear();
-	uploadingId = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < cNetUploadSessionsCount(); ++i) {
-		sentSizes[i] = 0;
-	}
-
 	sendNext();
 }
 
@@ -398,7 +463,7 @@ void Uploader::notifyFailed(FullMsgId id, const File &file) {
 	} else if (type == SendMediaType::Secure) {
 		_secureFailed.fire_copy(id);
 	} else {
-		Unexpected("Type in Uploader::currentFailed.");
+		Unexpected("Type in Uploader::notifyFailed.");
 	}
 }
 
@@ -406,12 +471,51 @@ void Uploader::stopSessions() {
 	for (int i = 0; i < cNetUploadSessionsCount(); ++i) {
 		_api->instance().stopSession(MTP::uploadDcId(i));
 	}
+	resetSessionWindows();
+}
+
+void Uploader::resetSessionWindows() {
+	for (auto &session : _sessions) {
+		session = SessionWindow{ .window = kMinSessionWindow };
+	}
+}
+
+int Uploader::chooseSession(int64 size) const {
+	auto result = -1;
+	auto resultFree = int64();
+	for (auto i = 0; i != cNetUploadSessionsCount(); ++i) {
+		const auto &session = _sessions[i];
+		const auto free = session.window - session.sent;
+		if ((!session.sent || free >= size)
+			&& (result < 0 || free > resultFree)) {
+			result = i;
+			resultFree = free;
+		}
+	}
+	return result;
+}
+
+void Uploader::updateSessionWindow(
+		int dcIndex,
+		int64 size,
+		crl::time latency) {
+	auto &session = _sessions[dcIndex];
+	latency = std::max(latency, crl::time(1));
+	if (!session.minLatency || latency < session.minLatency) {
+		session.minLatency = latency;
+	}
+	session.window = (latency
+		<= session.minLatency * kWindowGrowLatencyFactor)
+		? std::min(session.window + size, kMaxSessionWindow)
+		: std::max(session.window - size / 2, kMinSessionWindow);
 }
 
 void Uploader::sendNext() {
-	if (sentSize >= (cNetUploadSessionsCount() * 512 * 1024) || _pausedId.msg) {
+	if (_pausedId.msg) {
 		return;
 	}
+	while (!queue.empty() && sendPart()) {
+	}
 
 	const auto stopping = _stopSessionsTimer.isActive();
 	if (queue.empty()) {
@@ -419,234 +523,301 @@ void Uploader::sendNext() {
 			_stopSessionsTimer.callOnce(kKillSessionTimeout);
 		}
 		return;
-	}
-
-	if (stopping) {
+	} else if (stopping) {
 		_stopSessionsTimer.cancel();
 	}
-	auto i = uploadingId.msg ? queue.find(uploadingId) : queue.begin();
-	if (!uploadingId.msg) {
-		uploadingId = i->first;
-	} else if (i == queue.end()) {
-		i = queue.begin();
-		uploadingId = i->first;
-	}
-	auto &uploadingData = i->second;
-
-	auto todc = 0;
-	for (auto dc = 1; dc != cNetUploadSessionsCount(); ++dc) {
-		if (sentSizes[dc] < sentSizes[todc]) {
-			todc = dc;
-		}
+	if (!_requests.empty()) {
+		_nextTimer.callOnce(crl::time(cNetUploadRequestInterval()));
 	}
+}
 
-	auto &parts = uploadingData.file
-		? ((uploadingData.type() == SendMediaType::Photo
-			|| uploadingData.type() == SendMediaType::Secure)
-			? uploadingData.file->fileparts
-			: uploadingData.file->thumbparts)
-		: uploadingData.media.parts;
-	const auto partsOfId = uploadingData.file
-		? ((uploadingData.type() == SendMediaType::Photo
-			|| uploadingData.type() == SendMediaType::Secure)
-			? uploadingData.file->id
-			: uploadingData.file->thumbId)
-		: uploadingData.media.thumbId;
-	if (parts.isEmpty()) {
-		if (uploadingData.docSentParts >= uploadingData.docPartsCount) {
-			if (requestsSent.empty() && docRequestsSent.empty()) {
-				const auto options = uploadingData.file
-					? uploadingData.file->to.options
-					: Api::SendOptions();
-				const auto edit = uploadingData.file &&
-					uploadingData.file->to.replaceMediaOf;
-				const auto attachedStickers = uploadingData.file
-					? uploadingData.file->attachedStickers
-					: std::vector<MTPInputDocument>();
-				if (uploadingData.type() == SendMediaType::Photo) {
-					auto photoFilename = uploadingData.filename();
-					if (!photoFilename.endsWith(u".jpg"_q, Qt::CaseInsensitive)) {
-						// Server has some extensions checking for inputMediaUploadedPhoto,
-						// so force the extension to be .jpg anyway. It doesn't matter,
-						// because the filename from inputFile is not used anywhere.
-						photoFilename += u".jpg"_q;
-					}
-					const auto md5 = uploadingData.file
-						? uploadingData.file->filemd5
-						: uploadingData.media.jpeg_md5;
-					const auto file = MTP_inputFile(
-						MTP_long(uploadingData.id()),
-						MTP_int(uploadingData.partsCount),
-						MTP_string(photoFilename),
-						MTP_bytes(md5));
-					_photoReady.fire({
-						.fullId = uploadingId,
-						.info = {
-							.file = file,
-							.attachedStickers = attachedStickers,
-						},
-						.options = options,
-						.edit = edit,
-					});
-				} else if (uploadingData.type() == SendMediaType::File
-					|| uploadingData.type() == SendMediaType::ThemeFile
-					|| uploadingData.type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
-
-					const auto file = (uploadingData.docSize > kUseBigFilesFrom)
-						? MTP_inputFileBig(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()))
-						: MTP_inputFile(
-							MTP_long(uploadingData.id()),
-							MTP_int(uploadingData.docPartsCount),
-							MTP_string(uploadingData.filename()),
-							MTP_bytes(docMd5));
-					const auto thumb = [&]() -> std::optional<MTPInputFile> {
-						if (!uploadingData.partsCount) {
-							return std::nullopt;
-						}
-						const auto thumbFilename = uploadingData.file
-							? uploadingData.file->thumbname
-							: (u"thumb."_q + uploadingData.media.thumbExt);
-						const auto thumbMd5 = uploadingData.file
-							? uploadingData.file->thumbmd5
-							: uploadingData.media.jpeg_md5;
-						return MTP_inputFile(
-							MTP_long(uploadingData.thumbId()),
-							MTP_int(uploadingData.partsCount),
-							MTP_string(thumbFilename),
-							MTP_bytes(thumbMd5));
-					}();
-					_documentReady.fire({
-						.fullId = uploadingId,
-						.info = {
-							.file = file,
-							.thumb = thumb,
-							.attachedStickers = attachedStickers,
-						},
-						.options = options,
-						.edit = edit,
-					});
-				} else if (uploadingData.type() == SendMediaType::Secure) {
-					_secureReady.fire({
-						uploadingId,
-						uploadingData.id(),
-						uploadingData.partsCount });
-				}
-				queue.erase(uploadingId);
-				uploadingId = FullMsgId();
-				sendNext();
-			}
-			return;
+bool Uploader::sendPart() {
+	auto chosen = queue.end();
+	auto index = 0;
+	for (auto i = queue.begin()
+		; i != queue.end() && index != kUploadFilesInParallel
+		; ++i, ++index) {
+		auto &file = i->second;
+		if (file.content().isEmpty()
+			&& file.docSentParts < file.docPartsCount) {
+			readDocumentParts(i->first, file);
 		}
-
-		auto &content = uploadingData.file
-			? uploadingData.file->content
-			: uploadingData.media.data;
-		QByteArray toSend;
-		if (content.isEmpty()) {
-			if (!uploadingData.docFile) {
-				const auto filepath = uploadingData.file
-					? uploadingData.file->filepath
-					: uploadingData.media.file;
-				uploadingData.docFile = std::make_unique<QFile>(filepath);
-				if (!uploadingData.docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
-				}
+		if (file.nextPartSize() > 0) {
+			if (chosen == queue.end()
+				|| file.requestsSize < chosen->second.requestsSize) {
+				chosen = i;
 			}
-			toSend = uploadingData.docFile->read(uploadingData.docPartSize);
-			if (uploadingData.docSize <= kUseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
-			}
-		} else {
-			const auto offset = uploadingData.docSentParts
-				* uploadingData.docPartSize;
-			toSend = content.mid(offset, uploadingData.docPartSize);
-			if ((uploadingData.type() == SendMediaType::File
-				|| uploadingData.type() == SendMediaType::ThemeFile
-				|| uploadingData.type() == SendMediaType::Audio)
-				&& uploadingData.docSentParts <= kUseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
-			}
-		}
-		if ((toSend.size() > uploadingData.docPartSize)
-			|| ((toSend.size() < uploadingData.docPartSize
-				&& uploadingData.docSentParts + 1 != uploadingData.docPartsCount))) {
-			currentFailed();
-			return;
+		} else if (i == queue.begin()
+			&& file.docSentParts >= file.docPartsCount
+			&& !file.requests) {
+			// Files are finished in the queue order,
+			// so that the messages are sent in the right order.
+			finishFile(i);
+			return true;
 		}
-		mtpRequestId requestId;
-		if (uploadingData.docSize > kUseBigFilesFrom) {
-			requestId = _api->request(MTPupload_SaveBigFilePart(
-				MTP_long(uploadingData.id()),
-				MTP_int(uploadingData.docSentParts),
-				MTP_int(uploadingData.docPartsCount),
-				MTP_bytes(toSend)
-			)).done([=](const MTPBool &result, mtpRequestId requestId) {
-				partLoaded(result, requestId);
-			}).fail([=](const MTP::Error &error, mtpRequestId requestId) {
-				partFailed(error, requestId);
-			}).toDC(MTP::uploadDcId(todc)).send();
-		} else {
-			requestId = _api->request(MTPupload_SaveFilePart(
-				MTP_long(uploadingData.id()),
-				MTP_int(uploadingData.docSentParts),
-				MTP_bytes(toSend)
-			)).done([=](const MTPBool &result, mtpRequestId requestId) {
-				partLoaded(result, requestId);
-			}).fail([=](const MTP::Error &error, mtpRequestId requestId) {
-				partFailed(error, requestId);
-			}).toDC(MTP::uploadDcId(todc)).send();
+	}
+	if (chosen == queue.end()) {
+		return false;
+	}
+	const auto dcIndex = chooseSession(chosen->second.nextPartSize());
+	if (dcIndex < 0) {
+		return false;
+	} else if (!sendFilePart(chosen->first, chosen->second, dcIndex)) {
+		fileFailed(chosen->first);
+		return false;
+	}
+	return true;
+}
+
+bool Uploader::sendFilePart(
+		const FullMsgId &itemId,
+		File &file,
+		int dcIndex) {
+	const auto done = [=](const MTPBool &result, mtpRequestId requestId) {
+		partLoaded(result, requestId);
+	};
+	const auto fail = [=](const MTP::Error &error, mtpRequestId requestId) {
+		partFailed(error, requestId);
+	};
+	const auto registerRequest = [&](
+			mtpRequestId requestId,
+			int64 size,
+			bool docPart) {
+		_requests.emplace(requestId, Request{
+			.itemId = itemId,
+			.size = size,
+			.dcIndex = dcIndex,
+			.sent = crl::now(),
+			.docPart = docPart,
+		});
+		_sessions[dcIndex].sent += size;
+		file.requestsSize += size;
+		++file.requests;
+		if (docPart) {
+			++file.docRequests;
 		}
-		docRequestsSent.emplace(requestId, uploadingData.docSentParts);
-		dcMap.emplace(requestId, todc);
-		sentSize += uploadingData.docPartSize;
-		sentSizes[todc] += uploadingData.docPartSize;
+		file.started = true;
+	};
 
-		uploadingData.docSentParts++;
-	} else {
+	auto &parts = file.parts();
+	if (!parts.isEmpty()) {
 		auto part = parts.begin();
 
 		const auto requestId = _api->request(MTPupload_SaveFilePart(
-			MTP_long(partsOfId),
+			MTP_long(file.partsOfId()),
 			MTP_int(part.key()),
 			MTP_bytes(part.value())
-		)).done([=](const MTPBool &result, mtpRequestId requestId) {
-			partLoaded(result, requestId);
-		}).fail([=](const MTP::Error &error, mtpRequestId requestId) {
-			partFailed(error, requestId);
-		}).toDC(MTP::uploadDcId(todc)).send();
-		requestsSent.emplace(requestId, part.value());
-		dcMap.emplace(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
+		)).done(done).fail(fail).toDC(MTP::uploadDcId(dcIndex)).send();
+		registerRequest(requestId, part.value().size(), false);
 
 		parts.erase(part);
+		return true;
 	}
-	_nextTimer.callOnce(crl::time(cNetUploadRequestInterval()));
+
+	auto &content = file.content();
+	auto toSend = QByteArray();
+	if (content.isEmpty()) {
+		Assert(!file.docReadParts.empty());
+		toSend = std::move(file.docReadParts.front());
+		file.docReadParts.pop_front();
+	} else {
+		const auto offset = file.docSentParts * file.docPartSize;
+		toSend = content.mid(offset, file.docPartSize);
+		if ((file.type() == SendMediaType::File
+			|| file.type() == SendMediaType::ThemeFile
+			|| file.type() == SendMediaType::Audio)
+			&& file.docSentParts <= kUseBigFilesFrom) {
+			file.md5Hash.feed(toSend.constData(), toSend.size());
+		}
+	}
+	if ((toSend.size() > file.docPartSize)
+		|| ((toSend.size() < file.docPartSize
+			&& file.docSentParts + 1 != file.docPartsCount))) {
+		return false;
+	}
+	const auto requestId = (file.docSize > kUseBigFilesFrom)
+		? _api->request(MTPupload_SaveBigFilePart(
+			MTP_long(file.id()),
+			MTP_int(file.docSentParts),
+			MTP_int(file.docPartsCount),
+			MTP_bytes(toSend)
+		)).done(done).fail(fail).toDC(MTP::uploadDcId(dcIndex)).send()
+		: _api->request(MTPupload_SaveFilePart(
+			MTP_long(file.id()),
+			MTP_int(file.docSentParts),
+			MTP_bytes(toSend)
+		)).done(done).fail(fail).toDC(MTP::uploadDcId(dcIndex)).send();
+	registerRequest(requestId, toSend.size(), true);
+
+	++file.docSentParts;
+	return true;
+}
+
+void Uploader::readDocumentParts(const FullMsgId &itemId, File &file) {
+	const auto count = std::min(
+		kReadAheadParts - int(file.docReadParts.size()),
+		file.docPartsCount - file.docReadPartsCount);
+	if (file.docReading || count <= 0) {
+		return;
+	} else if (!file.docReader) {
+		file.docReader = std::make_shared<FileReader>();
+		file.docReader->file.setFileName(file.filepath());
+		file.docReader->hash = (file.docSize <= kUseBigFilesFrom);
+	}
+	file.docReading = true;
+	crl::async([
+		=,
+		weak = base::make_weak(this),
+		reader = file.docReader,
+		partSize = file.docPartSize
+	] {
+		auto parts = std::vector<QByteArray>();
+		auto failed = !reader->file.isOpen()
+			&& !reader->file.open(QIODevice::ReadOnly);
+		for (auto i = 0; !failed && i != count; ++i) {
+			auto bytes = reader->file.read(partSize);
+			if (bytes.isEmpty()) {
+				failed = true;
+			} else {
+				if (reader->hash) {
+					reader->md5Hash.feed(bytes.constData(), bytes.size());
+				}
+				parts.push_back(std::move(bytes));
+			}
+		}
+		crl::on_main(weak, [=, parts = std::move(parts)]() mutable {
+			documentPartsRead(itemId, reader, std::move(parts), failed);
+		});
+	});
+}
+
+void Uploader::documentPartsRead(
+		const FullMsgId &itemId,
+		const std::shared_ptr<FileReader> &reader,
+		std::vector<QByteArray> &&parts,
+		bool failed) {
+	const auto i = queue.find(itemId);
+	if (i == queue.end() || i->second.docReader != reader) {
+		return;
+	} else if (failed) {
+		fileFailed(itemId);
+		return;
+	}
+	auto &file = i->second;
+	file.docReading = false;
+	file.docReadPartsCount += int(parts.size());
+	for (auto &bytes : parts) {
+		file.docReadParts.push_back(std::move(bytes));
+	}
+	if (reader->hash && file.docReadPartsCount == file.docPartsCount) {
+		file.md5Hash = reader->md5Hash;
+	}
+	sendNext();
+}
+
+void Uploader::finishFile(std::map<FullMsgId, File>::iterator i) {
+	const auto uploadingId = i->first;
+	auto &uploadingData = i->second;
+	const auto options = uploadingData.file
+		? uploadingData.file->to.options
+		: Api::SendOptions();
+	const auto edit = uploadingData.file &&
+		uploadingData.file->to.replaceMediaOf;
+	const auto attachedStickers = uploadingData.file
+		? uploadingData.file->attachedStickers
+		: std::vector<MTPInputDocument>();
+	if (uploadingData.type() == SendMediaType::Photo) {
+		auto photoFilename = uploadingData.filename();
+		if (!photoFilename.endsWith(u".jpg"_q, Qt::CaseInsensitive)) {
+			// Server has some extensions checking for inputMediaUploadedPhoto,
+			// so force the extension to be .jpg anyway. It doesn't matter,
+			// because the filename from inputFile is not used anywhere.
+			photoFilename += u".jpg"_q;
+		}
+		const auto md5 = uploadingData.file
+			? uploadingData.file->filemd5
+			: uploadingData.media.jpeg_md5;
+		const auto file = MTP_inputFile(
+			MTP_long(uploadingData.id()),
+			MTP_int(uploadingData.partsCount),
+			MTP_string(photoFilename),
+			MTP_bytes(md5));
+		_photoReady.fire({
+			.fullId = uploadingId,
+			.info = {
+				.file = file,
+				.attachedStickers = attachedStickers,
+			},
+			.options = options,
+			.edit = edit,
+		});
+	} else if (uploadingData.type() == SendMediaType::File
+		|| uploadingData.type() == SendMediaType::ThemeFile
+		|| uploadingData.type() == SendMediaType::Audio) {
+		QByteArray docMd5(32, Qt::Uninitialized);
+		hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
+
+		const auto file = (uploadingData.docSize > kUseBigFilesFrom)
+			? MTP_inputFileBig(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docPartsCount),
+				MTP_string(uploadingData.filename()))
+			: MTP_inputFile(
+				MTP_long(uploadingData.id()),
+				MTP_int(uploadingData.docPartsCount),
+				MTP_string(uploadingData.filename()),
+				MTP_bytes(docMd5));
+		const auto thumb = [&]() -> std::optional<MTPInputFile> {
+			if (!uploadingData.partsCount) {
+				return std::nullopt;
+			}
+			const auto thumbFilename = uploadingData.file
+				? uploadingData.file->thumbname
+				: (u"thumb."_q + uploadingData.media.thumbExt);
+			const auto thumbMd5 = uploadingData.file
+				? uploadingData.file->thumbmd5
+				: uploadingData.media.jpeg_md5;
+			return MTP_inputFile(
+				MTP_long(uploadingData.thumbId()),
+				MTP_int(uploadingData.partsCount),
+				MTP_string(thumbFilename),
+				MTP_bytes(thumbMd5));
+		}();
+		_documentReady.fire({
+			.fullId = uploadingId,
+			.info = {
+				.file = file,
+				.thumb = thumb,
+				.attachedStickers = attachedStickers,
+			},
+			.options = options,
+			.edit = edit,
+		});
+	} else if (uploadingData.type() == SendMediaType::Secure) {
+		_secureReady.fire({
+			uploadingId,
+			uploadingData.id(),
+			uploadingData.partsCount });
+	}
+	queue.erase(uploadingId);
 }
 
 void Uploader::cancel(const FullMsgId &msgId) {
-	if (uploadingId == msgId) {
-		currentFailed();
+	const auto i = queue.find(msgId);
+	if (i == queue.end()) {
+		return;
+	} else if (i->second.started) {
+		fileFailed(msgId);
 	} else {
-		queue.erase(msgId);
+		queue.erase(i);
 	}
 }
 
 void Uploader::cancelAll() {
-	const auto single = queue.empty() ? uploadingId : queue.begin()->first;
-	if (!single) {
+	if (queue.empty()) {
 		return;
 	}
-	_pausedId = single;
-	if (uploadingId) {
-		currentFailed();
-	}
+	_pausedId = queue.begin()->first;
 	while (!queue.empty()) {
 		const auto [msgId, file] = std::move(*queue.begin());
 		queue.erase(queue.begin());
@@ -669,88 +840,89 @@ void Uploader::confirm(const FullMsgId &msgId) {
 }
 
 void Uploader::cancelRequests() {
-	for (const auto &requestData : requestsSent) {
-		_api->request(requestData.first).cancel();
+	for (const auto &[requestId, request] : base::take(_requests)) {
+		_api->request(requestId).cancel();
+	}
+	for (auto &session : _sessions) {
+		session.sent = 0;
 	}
-	requestsSent.clear();
-	for (const auto &requestData : docRequestsSent) {
-		_api->request(requestData.first).cancel();
+}
+
+void Uploader::cancelRequests(const FullMsgId &itemId) {
+	for (auto i = _requests.begin(); i != _requests.end();) {
+		if (i->second.itemId == itemId) {
+			_api->request(i->first).cancel();
+			_sessions[i->second.dcIndex].sent -= i->second.size;
+			i = _requests.erase(i);
+		} else {
+			++i;
+		}
 	}
-	docRequestsSent.clear();
 }
 
 void Uploader::clear() {
 	queue.clear();
 	cancelRequests();
-	dcMap.clear();
-	sentSize = 0;
 	for (int i = 0; i < cNetUploadSessionsCount(); ++i) {
 		_api->instance().stopSession(MTP::uploadDcId(i));
-		sentSizes[i] = 0;
 	}
+	resetSessionWindows();
 	_stopSessionsTimer.cancel();
 }
 
 void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
-	auto j = docRequestsSent.end();
-	auto i = requestsSent.find(requestId);
-	if (i == requestsSent.cend()) {
-		j = docRequestsSent.find(requestId);
-	}
-	if (i != requestsSent.cend() || j != docRequestsSent.cend()) {
-		if (mtpIsFalse(result)) { // failed to upload current file
-			currentFailed();
-			return;
-		} else {
-			auto dcIt = dcMap.find(requestId);
-			if (dcIt == dcMap.cend()) { // must not happen
-				currentFailed();
-				return;
-			}
-			auto dc = dcIt->second;
-			dcMap.erase(dcIt);
-
-			int64 sentPartSize = 0;
-			auto k = queue.find(uploadingId);
-			Assert(k != queue.cend());
-			auto &[fullId, file] = *k;
-			if (i != requestsSent.cend()) {
-				sentPartSize = i->second.size();
-				requestsSent.erase(i);
-			} else {
-				sentPartSize = file.docPartSize;
-				docRequestsSent.erase(j);
-			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
-			if (file.type() == SendMediaType::Photo) {
-				file.fileSentSize += sentPartSize;
-				const auto photo = session().data().photo(file.id());
-				if (photo->uploading() && file.file) {
-					photo->uploadingData->size = file.file->partssize;
-					photo->uploadingData->offset = file.fileSentSize;
-				}
-				_photoProgress.fire_copy(fullId);
-			} else if (file.type() == SendMediaType::File
-				|| file.type() == SendMediaType::ThemeFile
-				|| file.type() == SendMediaType::Audio) {
-				const auto document = session().data().document(file.id());
-				if (document->uploading()) {
-					const auto doneParts = file.docSentParts
-						- int(docRequestsSent.size());
-					document->uploadingData->offset = std::min(
-						document->uploadingData->size,
-						doneParts * file.docPartSize);
-				}
-				_documentProgress.fire_copy(fullId);
-			} else if (file.type() == SendMediaType::Secure) {
-				file.fileSentSize += sentPartSize;
-				_secureProgress.fire_copy({
-					fullId,
-					file.fileSentSize,
-					file.file->partssize });
-			}
+	const auto i = _requests.find(requestId);
+	if (i == _requests.end()) {
+		sendNext();
+		return;
+	}
+	const auto request = i->second;
+	_requests.erase(i);
+	_sessions[request.dcIndex].sent -= request.size;
+	updateSessionWindow(
+		request.dcIndex,
+		request.size,
+		crl::now() - request.sent);
+
+	const auto k = queue.find(request.itemId);
+	if (k == queue.end()) {
+		sendNext();
+		return;
+	} else if (mtpIsFalse(result)) { // failed to upload current file
+		fileFailed(request.itemId);
+		return;
+	}
+	auto &[fullId, file] = *k;
+	file.requestsSize -= request.size;
+	--file.requests;
+	if (request.docPart) {
+		--file.docRequests;
+	}
+	if (file.type() == SendMediaType::Photo) {
+		file.fileSentSize += request.size;
+		const auto photo = session().data().photo(file.id());
+		if (photo->uploading() && file.file) {
+			photo->uploadingData->size = file.file->partssize;
+			photo->uploadingData->offset = file.fileSentSize;
 		}
+		_photoProgress.fire_copy(fullId);
+	} else if (file.type() == SendMediaType::File
+		|| file.type() == SendMediaType::ThemeFile
+		|| file.type() == SendMediaType::Audio) {
+		const auto document = session().data().document(file.id());
+		if (document->uploading()) {
+			const auto doneParts = file.docSentParts - file.docRequests;
+			document->uploadingData->offset = std::min(
+				document->uploadingData->size,
+				doneParts * file.docPartSize);
+		}
+		_documentProgress.fire_copy(fullId);
+	} else if (file.type() == SendMediaType::Secure) {
+		file.fileSentSize += request.size;
+		_secureProgress.fire_copy({
+			fullId,
+			file.fileSentSize,
+			file.file->partssize });
 	}
 
 	sendNext();
@@ -758,9 +930,13 @@ void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
 
 void Uploader::partFailed(const MTP::Error &error, mtpRequestId requestId) {
 	// failed to upload current file
-	if ((requestsSent.find(requestId) != requestsSent.cend())
-		|| (docRequestsSent.find(requestId) != docRequestsSent.cend())) {
-		currentFailed();
+	const auto i = _requests.find(requestId);
+	if (i != _requests.end()) {
+		const auto request = i->second;
+		_requests.erase(i);
+		_sessions[request.dcIndex].sent -= request.size;
+		fileFailed(request.itemId);
+		return;
 	}
 	sendNext();
 }
@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "api/api_common.h"
 #include "base/timer.h"
+#include "base/weak_ptr.h"
 #include "mtproto/facade.h"
 
 class ApiWrap;
@@ -47,16 +48,14 @@ struct UploadSecureDone {
 	int partsCount = 0;
 };
 
-class Uploader final : public QObject {
+class Uploader final : public QObject, public base::has_weak_ptr {
 public:
 	explicit Uploader(not_null<ApiWrap*> api);
 	~Uploader();
 
 	[[nodiscard]] Main::Session &session() const;
 
-	[[nodiscard]] FullMsgId currentUploadId() const {
-		return uploadingId;
-	}
+	[[nodiscard]] FullMsgId currentUploadId() const;
 
 	void uploadMedia(const FullMsgId &msgId, const SendMediaReady &image);
 	void upload(
@@ -104,6 +103,35 @@ public:
 
 private:
 	struct File;
+	struct FileReader;
+	struct Request {
+		FullMsgId itemId;
+		int64 size = 0;
+		int dcIndex = 0;
+		crl::time sent = 0;
+		bool docPart = false;
+	};
+	struct SessionWindow {
+		int64 sent = 0;
+		int64 window = 0;
+		crl::time minLatency = 0;
+	};
+
+	[[nodiscard]] bool sendPart();
+	[[nodiscard]] bool sendFilePart(
+		const FullMsgId &itemId,
+		File &file,
+		int dcIndex);
+	[[nodiscard]] int chooseSession(int64 size) const;
+	void updateSessionWindow(int dcIndex, int64 size, crl::time latency);
+	void resetSessionWindows();
+	void readDocumentParts(const FullMsgId &itemId, File &file);
+	void documentPartsRead(
+		const FullMsgId &itemId,
+		const std::shared_ptr<FileReader> &reader,
+		std::vector<QByteArray> &&parts,
+		bool failed);
+	void finishFile(std::map<FullMsgId, File>::iterator i);
 
 	void partLoaded(const MTPBool &result, mtpRequestId requestId);
 	void partFailed(const MTP::Error &error, mtpRequestId requestId);
@@ -114,8 +142,9 @@ private:
 	void processDocumentFailed(const FullMsgId &msgId);
 
 	void notifyFailed(FullMsgId id, const File &file);
-	void currentFailed();
+	void fileFailed(const FullMsgId &itemId);
 	void cancelRequests();
+	void cancelRequests(const FullMsgId &itemId);
 
 	void sendProgressUpdate(
 		not_null<HistoryItem*> item,
@@ -123,13 +152,9 @@ private:
 		int progress = 0);
 
 	const not_null<ApiWrap*> _api;
-	base::flat_map<mtpRequestId, QByteArray> requestsSent;
-	base::flat_map<mtpRequestId, int32> docRequestsSent;
-	base::flat_map<mtpRequestId, int32> dcMap;
-	uint32 sentSize = 0; // FileSize: Right now any file size fits 32 bit.
-	uint32 sentSizes[MTP::kUploadSessionsCountMax] = { 0 };
+	base::flat_map<mtpRequestId, Request> _requests;
+	std::array<SessionWindow, MTP::kUploadSessionsCountMax> _sessions;
 
-	FullMsgId uploadingId;
 	FullMsgId _pausedId;
 	std::map<FullMsgId, File> queue;
 	base::Timer _nextTimer, _stopSessionsTimer;
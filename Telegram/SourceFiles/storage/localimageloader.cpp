@@ -257,7 +257,10 @@ SendMediaReady::SendMediaReady(
 	}
 }
 
-TaskQueue::TaskQueue(crl::time stopTimeoutMs) {
+TaskQueue::TaskQueue(crl::time stopTimeoutMs, int threads)
+: _threadsLimit((threads > 0)
+	? threads
+	: std::max(QThread::idealThreadCount(), 1)) {
 	if (stopTimeoutMs > 0) {
 		_stopTimer = new QTimer(this);
 		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
@@ -273,7 +276,7 @@ TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task) {
 		_tasksToProcess.push_back(std::move(task));
 	}
 
-	wakeThread();
+	wakeThreads();
 
 	return result;
 }
@@ -286,23 +289,85 @@ void TaskQueue::addTasks(std::vector<std::unique_ptr<Task>> &&tasks) {
 		}
 	}
 
-	wakeThread();
+	wakeThreads();
 }
 
-void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
+void TaskQueue::wakeThreads() {
+	const auto required = [&] {
+		QMutexLocker lock(&_tasksToProcessMutex);
+		return std::min(
+			int(_tasksToProcess.size() + _tasksInProcess.size()),
+			_threadsLimit);
+	}();
+	while (int(_threads.size()) < required) {
+		auto thread = Thread{
+			.thread = new QThread(),
+			.worker = new TaskQueueWorker(this),
+		};
+		thread.worker->moveToThread(thread.thread);
+
+		connect(
+			this,
+			SIGNAL(taskAdded()),
+			thread.worker,
+			SLOT(onTaskAdded()));
+		connect(
+			thread.worker,
+			SIGNAL(taskProcessed()),
+			this,
+			SLOT(onTaskProcessed()));
+
+		thread.thread->start();
+		_threads.push_back(thread);
+	}
+	if (_stopTimer) _stopTimer->stop();
+	taskAdded();
+}
 
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
+Task *TaskQueue::takeTaskToProcess() {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	if (_tasksToProcess.empty()) {
+		return nullptr;
+	}
+	auto &processing = _tasksInProcess.emplace_back(ProcessingTask{
+		.task = std::move(_tasksToProcess.front()),
+	});
+	_tasksToProcess.pop_front();
+	return processing.task.get();
+}
 
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+auto TaskQueue::taskProcessed(not_null<Task*> task) -> ProcessedResult {
+	auto result = ProcessedResult();
+	auto ready = std::vector<std::unique_ptr<Task>>();
+	auto cancelled = std::vector<std::unique_ptr<Task>>();
+	{
+		QMutexLocker lockToProcess(&_tasksToProcessMutex);
+		const auto proj = [](const ProcessingTask &processing) {
+			return processing.task.get();
+		};
+		const auto i = ranges::find(_tasksInProcess, task.get(), proj);
+		Assert(i != end(_tasksInProcess));
+		i->processed = true;
+
+		// Tasks processed out of order wait for all the previous ones.
+		while (!_tasksInProcess.empty()
+			&& _tasksInProcess.front().processed) {
+			auto &front = _tasksInProcess.front();
+			(front.cancelled ? cancelled : ready).push_back(
+				std::move(front.task));
+			_tasksInProcess.pop_front();
+		}
+		result.someTasksLeft = !_tasksToProcess.empty();
 
-		_thread->start();
+		if (!ready.empty()) {
+			QMutexLocker lockToFinish(&_tasksToFinishMutex);
+			result.emitTaskProcessed = _tasksToFinish.empty();
+			for (auto &processed : ready) {
+				_tasksToFinish.push_back(std::move(processed));
+			}
+		}
 	}
-	if (_stopTimer) _stopTimer->stop();
-	taskAdded();
+	return result;
 }
 
 void TaskQueue::cancelTask(TaskId id) {
@@ -318,8 +383,12 @@ void TaskQueue::cancelTask(TaskId id) {
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
 		removeFrom(_tasksToProcess);
-		if (_taskInProcessId == id) {
-			_taskInProcessId = TaskId();
+		const auto proj = [](const ProcessingTask &processing) {
+			return processing.task->id();
+		};
+		const auto i = ranges::find(_tasksInProcess, id, proj);
+		if (i != end(_tasksInProcess)) {
+			i->cancelled = true;
 		}
 	}
 	QMutexLocker lock(&_tasksToFinishMutex);
@@ -340,24 +409,28 @@ void TaskQueue::onTaskProcessed() {
 
 	if (_stopTimer) {
 		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.empty() && !_taskInProcessId) {
+		if (_tasksToProcess.empty() && _tasksInProcess.empty()) {
 			_stopTimer->start();
 		}
 	}
 }
 
 void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
+	for (const auto &thread : _threads) {
+		thread.thread->requestInterruption();
+		thread.thread->quit();
+	}
+	if (!_threads.empty()) {
 		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete base::take(_worker);
-		delete base::take(_thread);
+	}
+	for (const auto &thread : base::take(_threads)) {
+		thread.thread->wait();
+		delete thread.worker;
+		delete thread.thread;
 	}
 	_tasksToProcess.clear();
+	_tasksInProcess.clear();
 	_tasksToFinish.clear();
-	_taskInProcessId = TaskId();
 }
 
 TaskQueue::~TaskQueue() {
@@ -371,33 +444,15 @@ void TaskQueueWorker::onTaskAdded() {
 
 	bool someTasksLeft = false;
 	do {
-		auto task = std::unique_ptr<Task>();
-		{
-			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.empty()) {
-				task = std::move(_queue->_tasksToProcess.front());
-				_queue->_tasksToProcess.pop_front();
-				_queue->_taskInProcessId = task->id();
-			}
-		}
-
-		if (task) {
+		if (const auto task = _queue->takeTaskToProcess()) {
 			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (_queue->_taskInProcessId == task->id()) {
-					_queue->_taskInProcessId = TaskId();
-					someTasksLeft = !_queue->_tasksToProcess.empty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.empty();
-					_queue->_tasksToFinish.push_back(std::move(task));
-				}
-			}
-			if (emitTaskProcessed) {
+			const auto result = _queue->taskProcessed(task);
+			someTasksLeft = result.someTasksLeft;
+			if (result.emitTaskProcessed) {
 				taskProcessed();
 			}
+		} else {
+			someTasksLeft = false;
 		}
 		QCoreApplication::processEvents();
 	} while (someTasksLeft && !thread()->isInterruptionRequested());
@@ -91,7 +91,10 @@ class TaskQueue : public QObject {
 	Q_OBJECT
 
 public:
-	explicit TaskQueue(crl::time stopTimeoutMs = 0); // <= 0 - never stop worker
+	// stopTimeoutMs <= 0 - never stop workers.
+	// threads <= 0 - one worker for each processor core.
+	// Tasks are processed in parallel, but finished in the added order.
+	explicit TaskQueue(crl::time stopTimeoutMs = 0, int threads = 1);
 
 	TaskId addTask(std::unique_ptr<Task> &&task);
 	void addTasks(std::vector<std::unique_ptr<Task>> &&tasks);
@@ -109,14 +112,32 @@ public Q_SLOTS:
 private:
 	friend class TaskQueueWorker;
 
-	void wakeThread();
+	struct ProcessingTask {
+		std::unique_ptr<Task> task;
+		bool processed = false;
+		bool cancelled = false;
+	};
+	struct Thread {
+		QThread *thread = nullptr;
+		TaskQueueWorker *worker = nullptr;
+	};
+	struct ProcessedResult {
+		bool someTasksLeft = false;
+		bool emitTaskProcessed = false;
+	};
+
+	void wakeThreads();
+
+	// Worker threads.
+	[[nodiscard]] Task *takeTaskToProcess();
+	[[nodiscard]] ProcessedResult taskProcessed(not_null<Task*> task);
 
 	std::deque<std::unique_ptr<Task>> _tasksToProcess;
+	std::deque<ProcessingTask> _tasksInProcess; // In the added order.
 	std::deque<std::unique_ptr<Task>> _tasksToFinish;
-	TaskId _taskInProcessId = TaskId();
 	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread = nullptr;
-	TaskQueueWorker *_worker = nullptr;
+	std::vector<Thread> _threads;
+	int _threadsLimit = 1;
 	QTimer *_stopTimer = nullptr;
 
 };
@@ -43,7 +43,7 @@ using Database = Cache::Database;
 constexpr auto kDelayedWriteTimeout = crl::time(1000);
 
 constexpr auto kStickersVersionTag = quint32(-1);
-constexpr auto kStickersSerializeVersion = 3;
+constexpr auto kStickersSerializeVersion = 4;
 constexpr auto kMaxSavedStickerSetsCount = 1000;
 constexpr auto kDefaultStickerInstallDate = TimeId(1);
 
@@ -121,8 +121,89 @@ auto EmptyMessageDraftSources()
 	return cWorkingDir() + u"tdata/tdld/"_q;
 }
 
+[[nodiscard]] uint32 StickerSetSize(const Data::StickersSet &set) {
+	using SetFlag = Data::StickersSetFlag;
+
+	// id + accessHash + hash + title + shortName + stickersCount + flags + installDate
+	auto result = uint32(sizeof(quint64) * 3
+		+ Serialize::stringSize(set.title)
+		+ Serialize::stringSize(set.shortName)
+		+ sizeof(qint32) * 3
+		+ Serialize::imageLocationSize(set.thumbnailLocation()));
+	if (set.flags & SetFlag::NotLoaded) {
+		return result;
+	}
+
+	for (const auto sticker : std::as_const(set.stickers)) {
+		result += Serialize::Document::sizeInStream(sticker);
+	}
+
+	result += sizeof(qint32); // datesCount
+	if (!set.dates.empty()) {
+		Assert(set.stickers.size() == set.dates.size());
+		result += set.dates.size() * sizeof(qint32);
+	}
+
+	result += sizeof(qint32); // emojiCount
+	for (auto j = set.emoji.cbegin(), e = set.emoji.cend(); j != e; ++j) {
+		result += Serialize::stringSize(j->first->id())
+			+ sizeof(qint32)
+			+ (j->second.size() * sizeof(quint64));
+	}
+	return result;
+}
+
+// Changes when anything we write for the set changes, except the
+// documents themselves, those are rewritten on the next compaction.
+[[nodiscard]] uint64 StickerSetFingerprint(const Data::StickersSet &set) {
+	auto result = uint64(0xCBF29CE484222325ULL);
+	const auto mix = [&](uint64 value) {
+		result = (result ^ value) * 0x100000001B3ULL;
+	};
+	mix(set.id);
+	mix(set.accessHash);
+	mix(set.hash);
+	mix(qHash(set.title));
+	mix(qHash(set.shortName));
+	mix(uint64(set.count));
+	mix(uint64(set.flags.value()));
+	mix(uint64(set.installDate));
+	mix(set.thumbnailDocumentId);
+	mix(uint64(set.stickers.size()));
+	for (const auto sticker : std::as_const(set.stickers)) {
+		mix(sticker->id);
+	}
+	for (const auto date : set.dates) {
+		mix(uint64(date));
+	}
+	for (const auto &[emoji, pack] : set.emoji) {
+		mix(qHash(emoji->id()));
+		for (const auto sticker : pack) {
+			mix(sticker->id);
+		}
+	}
+	return result;
+}
+
 } // namespace
 
+struct Account::MapJournal {
+	JournalState state;
+
+	// All the map except drafts, as it was written last time.
+	QByteArray keys;
+	base::flat_map<PeerId, FileKey> drafts;
+	base::flat_map<PeerId, FileKey> draftCursors;
+};
+
+struct Account::StickersJournal {
+	JournalState state;
+
+	// Written set id -> fingerprint, zero if it should be rewritten.
+	base::flat_map<uint64, uint64> sets;
+	Data::StickersSetsOrder order;
+};
+
 Account::Account(not_null<Main::Account*> owner, const QString &dataName)
 : _owner(owner)
 , _dataName(dataName)
@@ -134,6 +215,7 @@ Account::Account(not_null<Main::Account*> owner, const QString &dataName)
 , _cacheBigFileTotalSizeLimit(Database::Settings().totalSizeLimit)
 , _cacheTotalTimeLimit(Database::Settings().totalTimeLimit)
 , _cacheBigFileTotalTimeLimit(Database::Settings().totalTimeLimit)
+, _mapJournal(std::make_unique<MapJournal>())
 , _writeMapTimer([=] { writeMap(); })
 , _writeLocationsTimer([=] { writeLocations(); }) {
 }
@@ -159,13 +241,27 @@ StartResult Account::legacyStart(const QByteArray &passcode) {
 	return StartResult::Success;
 }
 
+void Account::preload(const MTP::AuthKeyPtr &localKey) {
+	Expects(localKey != nullptr);
+
+	PreloadFile(u"map"_q, _basePath);
+	PreloadFile(ToFilePart(_dataNameKey), BaseGlobalPath(), localKey);
+	PreloadFile(u"config"_q, _basePath, localKey);
+}
+
 std::unique_ptr<MTP::Config> Account::start(MTP::AuthKeyPtr localKey) {
 	Expects(localKey != nullptr);
 
 	_localKey = std::move(localKey);
 	readMapWith(_localKey);
 	clearLegacyFiles();
-	return readMtpConfig();
+	auto result = readMtpConfig();
+
+	// Files that were preloaded, but not read, are not needed anymore.
+	ForgetPreloadedFile(u"map"_q, _basePath);
+	ForgetPreloadedFile(ToFilePart(_dataNameKey), BaseGlobalPath());
+	ForgetPreloadedFile(u"config"_q, _basePath);
+	return result;
 }
 
 void Account::startAdded(MTP::AuthKeyPtr localKey) {
@@ -212,6 +308,7 @@ base::flat_set<QString> Account::collectGoodNames() const {
 		"map0",
 		"map1",
 		"maps",
+		"mapj",
 		"configs",
 	};
 	const auto push = [&](FileKey key) {
@@ -224,6 +321,8 @@ base::flat_set<QString> Account::collectGoodNames() const {
 		result.emplace(name);
 		name[name.size() - 1] = 's';
 		result.emplace(name);
+		name[name.size() - 1] = 'j';
+		result.emplace(name);
 	};
 	for (const auto &[key, value] : _draftsMap) {
 		push(value);
@@ -248,8 +347,11 @@ Account::ReadMapResult Account::readMapWith(
 	}
 	LOG(("App Info: reading map..."));
 
-	QByteArray legacySalt, legacyKeyEncrypted, mapEncrypted;
+	QByteArray legacySalt, legacyKeyEncrypted, mapEncrypted, mapJournal;
 	mapData.stream >> legacySalt >> legacyKeyEncrypted >> mapEncrypted;
+	if (!mapData.stream.atEnd()) {
+		mapData.stream >> mapJournal;
+	}
 	if (!CheckStreamStatus(mapData.stream)) {
 		return ReadMapResult::Failed;
 	}
@@ -406,6 +508,53 @@ Account::ReadMapResult Account::readMapWith(
 		}
 	}
 
+	auto journal = MapJournal{
+		.state = { .baseSize = map.data.size() },
+	};
+	if (mapJournal.size() == sizeof(quint64)) {
+		auto generation = quint64();
+		QDataStream(mapJournal) >> generation;
+		journal.state.generation = generation;
+	}
+	ReadJournal(u"map"_q, _basePath, journal.state, localKey, [&](
+			EncryptedDescriptor &record,
+			int32) {
+		while (!record.stream.atEnd()) {
+			quint32 keyType = 0, count = 0;
+			record.stream >> keyType >> count;
+			if (keyType != lskDraft && keyType != lskDraftPosition) {
+				return false;
+			}
+			auto &keys = (keyType == lskDraft) ? draftsMap : draftCursorsMap;
+			for (quint32 i = 0; i < count; ++i) {
+				FileKey key;
+				quint64 peerIdSerialized;
+				record.stream >> key >> peerIdSerialized;
+				const auto peerId = DeserializePeerId(peerIdSerialized);
+				if (key) {
+					keys[peerId] = key;
+				} else {
+					keys.remove(peerId);
+				}
+				if (keyType != lskDraft) {
+					continue;
+				} else if (key) {
+					draftsNotReadMap[peerId] = true;
+				} else {
+					draftsNotReadMap.remove(peerId);
+				}
+			}
+			if (!CheckStreamStatus(record.stream)) {
+				return false;
+			}
+		}
+		return true;
+	});
+	if (journal.state.records) {
+		LOG(("App Info: map journal records applied: %1"
+			).arg(journal.state.records));
+	}
+
 	_localKey = std::move(localKey);
 
 	_draftsMap = draftsMap;
@@ -438,6 +587,11 @@ Account::ReadMapResult Account::readMapWith(
 		writeMapDelayed();
 	} else {
 		_mapChanged = false;
+
+		journal.keys = serializeMapKeys(selfSerialized);
+		journal.drafts = _draftsMap;
+		journal.draftCursors = _draftCursorsMap;
+		*_mapJournal = std::move(journal);
 	}
 
 	if (_locationsKey) {
@@ -490,11 +644,6 @@ void Account::writeMap() {
 		QDir().mkpath(_basePath);
 	}
 
-	FileWriteDescriptor map(u"map"_q, _basePath);
-	map.writeData(QByteArray());
-	map.writeData(QByteArray());
-
-	uint32 mapSize = 0;
 	const auto self = [&] {
 		if (!_owner->sessionExists()) {
 			DEBUG_LOG(("AuthSelf Warning: Session does not exist."));
@@ -517,31 +666,19 @@ void Account::writeMap() {
 		}
 		return result;
 	}();
-	if (!self.isEmpty()) mapSize += sizeof(quint32) + Serialize::bytearraySize(self);
+	auto keys = serializeMapKeys(self);
+
+	// If only the drafts were added or removed we append them to journal.
+	if (keys == _mapJournal->keys && writeMapJournal()) {
+		return;
+	}
+
+	const auto generation = NewJournalGeneration();
+	auto mapSize = uint32(keys.size());
 	if (!_draftsMap.empty()) mapSize += sizeof(quint32) * 2 + _draftsMap.size() * sizeof(quint64) * 2;
 	if (!_draftCursorsMap.empty()) mapSize += sizeof(quint32) * 2 + _draftCursorsMap.size() * sizeof(quint64) * 2;
-	if (_locationsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_trustedBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_recentStickersKeyOld) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_installedStickersKey || _featuredStickersKey || _recentStickersKey || _archivedStickersKey) {
-		mapSize += sizeof(quint32) + 4 * sizeof(quint64);
-	}
-	if (_favedStickersKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_savedGifsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_settingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_recentHashtagsAndBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_exportSettingsKey) mapSize += sizeof(quint32) + sizeof(quint64);
-	if (_installedMasksKey || _recentMasksKey || _archivedMasksKey) {
-		mapSize += sizeof(quint32) + 3 * sizeof(quint64);
-	}
-	if (_installedCustomEmojiKey || _featuredCustomEmojiKey || _archivedCustomEmojiKey) {
-		mapSize += sizeof(quint32) + 3 * sizeof(quint64);
-	}
 
 	EncryptedDescriptor mapData(mapSize);
-	if (!self.isEmpty()) {
-		mapData.stream << quint32(lskSelfSerialized) << self;
-	}
 	if (!_draftsMap.empty()) {
 		mapData.stream << quint32(lskDraft) << quint32(_draftsMap.size());
 		for (const auto &[key, value] : _draftsMap) {
@@ -554,51 +691,130 @@ void Account::writeMap() {
 			mapData.stream << quint64(value) << SerializePeerId(key);
 		}
 	}
+	mapData.stream.writeRawData(keys.constData(), keys.size());
+	const auto mapWritten = int64(mapData.data.size());
+
+	auto mapJournal = QByteArray();
+	QDataStream(&mapJournal, QIODevice::WriteOnly) << quint64(generation);
+	{
+		FileWriteDescriptor map(u"map"_q, _basePath);
+		map.writeData(QByteArray());
+		map.writeData(QByteArray());
+		map.writeEncrypted(mapData, _localKey);
+		map.writeData(mapJournal);
+	}
+	StartJournal(
+		u"map"_q,
+		_basePath,
+		_mapJournal->state,
+		generation,
+		mapWritten);
+	_mapJournal->keys = std::move(keys);
+	_mapJournal->drafts = _draftsMap;
+	_mapJournal->draftCursors = _draftCursorsMap;
+
+	_mapChanged = false;
+}
+
+QByteArray Account::serializeMapKeys(const QByteArray &self) const {
+	auto result = QByteArray();
+	QBuffer buffer(&result);
+	buffer.open(QIODevice::WriteOnly);
+	QDataStream mapData(&buffer);
+	mapData.setVersion(QDataStream::Qt_5_1);
+
+	if (!self.isEmpty()) {
+		mapData << quint32(lskSelfSerialized) << self;
+	}
 	if (_locationsKey) {
-		mapData.stream << quint32(lskLocations) << quint64(_locationsKey);
+		mapData << quint32(lskLocations) << quint64(_locationsKey);
 	}
 	if (_trustedBotsKey) {
-		mapData.stream << quint32(lskTrustedBots) << quint64(_trustedBotsKey);
+		mapData << quint32(lskTrustedBots) << quint64(_trustedBotsKey);
 	}
 	if (_recentStickersKeyOld) {
-		mapData.stream << quint32(lskRecentStickersOld) << quint64(_recentStickersKeyOld);
+		mapData << quint32(lskRecentStickersOld) << quint64(_recentStickersKeyOld);
 	}
 	if (_installedStickersKey || _featuredStickersKey || _recentStickersKey || _archivedStickersKey) {
-		mapData.stream << quint32(lskStickersKeys);
-		mapData.stream << quint64(_installedStickersKey) << quint64(_featuredStickersKey) << quint64(_recentStickersKey) << quint64(_archivedStickersKey);
+		mapData << quint32(lskStickersKeys);
+		mapData << quint64(_installedStickersKey) << quint64(_featuredStickersKey) << quint64(_recentStickersKey) << quint64(_archivedStickersKey);
 	}
 	if (_favedStickersKey) {
-		mapData.stream << quint32(lskFavedStickers) << quint64(_favedStickersKey);
+		mapData << quint32(lskFavedStickers) << quint64(_favedStickersKey);
 	}
 	if (_savedGifsKey) {
-		mapData.stream << quint32(lskSavedGifs) << quint64(_savedGifsKey);
+		mapData << quint32(lskSavedGifs) << quint64(_savedGifsKey);
 	}
 	if (_settingsKey) {
-		mapData.stream << quint32(lskUserSettings) << quint64(_settingsKey);
+		mapData << quint32(lskUserSettings) << quint64(_settingsKey);
 	}
 	if (_recentHashtagsAndBotsKey) {
-		mapData.stream << quint32(lskRecentHashtagsAndBots) << quint64(_recentHashtagsAndBotsKey);
+		mapData << quint32(lskRecentHashtagsAndBots) << quint64(_recentHashtagsAndBotsKey);
 	}
 	if (_exportSettingsKey) {
-		mapData.stream << quint32(lskExportSettings) << quint64(_exportSettingsKey);
+		mapData << quint32(lskExportSettings) << quint64(_exportSettingsKey);
 	}
 	if (_installedMasksKey || _recentMasksKey || _archivedMasksKey) {
-		mapData.stream << quint32(lskMasksKeys);
-		mapData.stream
+		mapData << quint32(lskMasksKeys);
+		mapData
 			<< quint64(_installedMasksKey)
 			<< quint64(_recentMasksKey)
 			<< quint64(_archivedMasksKey);
 	}
 	if (_installedCustomEmojiKey || _featuredCustomEmojiKey || _archivedCustomEmojiKey) {
-		mapData.stream << quint32(lskCustomEmojiKeys);
-		mapData.stream
+		mapData << quint32(lskCustomEmojiKeys);
+		mapData
 			<< quint64(_installedCustomEmojiKey)
 			<< quint64(_featuredCustomEmojiKey)
 			<< quint64(_archivedCustomEmojiKey);
 	}
-	map.writeEncrypted(mapData, _localKey);
+	return result;
+}
 
-	_mapChanged = false;
+bool Account::writeMapJournal() {
+	using Changes = std::vector<std::pair<PeerId, FileKey>>;
+	const auto collect = [](
+			const base::flat_map<PeerId, FileKey> &was,
+			const base::flat_map<PeerId, FileKey> &now) {
+		auto result = Changes();
+		for (const auto &[peerId, key] : now) {
+			const auto i = was.find(peerId);
+			if (i == end(was) || i->second != key) {
+				result.emplace_back(peerId, key);
+			}
+		}
+		for (const auto &[peerId, key] : was) {
+			if (!now.contains(peerId)) {
+				result.emplace_back(peerId, FileKey(0));
+			}
+		}
+		return result;
+	};
+	auto &journal = *_mapJournal;
+	const auto drafts = collect(journal.drafts, _draftsMap);
+	const auto cursors = collect(journal.draftCursors, _draftCursorsMap);
+	const auto size = sizeof(quint32) * 4
+		+ (drafts.size() + cursors.size()) * sizeof(quint64) * 2;
+	if (!journal.state.canAppend(size)) {
+		return false;
+	} else if (drafts.empty() && cursors.empty()) {
+		return true;
+	}
+
+	EncryptedDescriptor data(size);
+	const auto write = [&](quint32 keyType, const Changes &changes) {
+		data.stream << keyType << quint32(changes.size());
+		for (const auto &[peerId, key] : changes) {
+			data.stream << quint64(key) << SerializePeerId(peerId);
+		}
+	};
+	write(lskDraft, drafts);
+	write(lskDraftPosition, cursors);
+	AppendToJournal(u"map"_q, _basePath, journal.state, data, _localKey);
+
+	journal.drafts = _draftsMap;
+	journal.draftCursors = _draftCursorsMap;
+	return true;
 }
 
 void Account::reset() {
@@ -632,6 +848,8 @@ void Account::reset() {
 	_cacheTotalTimeLimit = Database::Settings().totalTimeLimit;
 	_cacheBigFileTotalSizeLimit = Database::Settings().totalSizeLimit;
 	_cacheBigFileTotalTimeLimit = Database::Settings().totalTimeLimit;
+	*_mapJournal = MapJournal();
+	_stickersJournals.clear();
 	_mapChanged = true;
 	writeMap();
 	writeMtpData();
@@ -641,6 +859,7 @@ void Account::reset() {
 			if (!name.endsWith(u"map0"_q)
 				&& !name.endsWith(u"map1"_q)
 				&& !name.endsWith(u"maps"_q)
+				&& !name.endsWith(u"mapj"_q)
 				&& !name.endsWith(u"configs"_q)) {
 				QFile::remove(base + name);
 			}
@@ -1680,18 +1899,11 @@ void Account::writeStickerSets(
 
 	const auto &sets = _owner->session().data().stickers().sets();
 	if (sets.empty()) {
-		if (stickersKey) {
-			ClearKey(stickersKey, _basePath);
-			stickersKey = 0;
-			writeMapDelayed();
-		}
+		clearStickerSets(stickersKey);
 		return;
 	}
 
-	// versionTag + version + count
-	quint32 size = sizeof(quint32) + sizeof(qint32) + sizeof(qint32);
-
-	int32 setsCount = 0;
+	auto list = std::vector<not_null<Data::StickersSet*>>();
 	for (const auto &[id, set] : sets) {
 		const auto raw = set.get();
 		auto result = checkSet(*raw);
@@ -1699,67 +1911,330 @@ void Account::writeStickerSets(
 			return;
 		} else if (result == StickerSetCheckResult::Skip) {
 			continue;
-		}
-
-		// id + accessHash + hash + title + shortName + stickersCount + flags + installDate
-		size += sizeof(quint64) * 3
-			+ Serialize::stringSize(raw->title)
-			+ Serialize::stringSize(raw->shortName)
-			+ sizeof(qint32) * 3
-			+ Serialize::imageLocationSize(raw->thumbnailLocation());
-		if (raw->flags & SetFlag::NotLoaded) {
+		} else if (!(raw->flags & SetFlag::NotLoaded)
+			&& raw->stickers.isEmpty()) {
+			// Nothing is written for such sets.
 			continue;
 		}
-
-		for (const auto sticker : std::as_const(raw->stickers)) {
-			size += Serialize::Document::sizeInStream(sticker);
-		}
-
-		size += sizeof(qint32); // datesCount
-		if (!raw->dates.empty()) {
-			Assert(raw->stickers.size() == raw->dates.size());
-			size += raw->dates.size() * sizeof(qint32);
-		}
-
-		size += sizeof(qint32); // emojiCount
-		for (auto j = raw->emoji.cbegin(), e = raw->emoji.cend(); j != e; ++j) {
-			size += Serialize::stringSize(j->first->id()) + sizeof(qint32) + (j->second.size() * sizeof(quint64));
-		}
-
-		++setsCount;
+		list.push_back(raw);
 	}
-	if (!setsCount && order.isEmpty()) {
-		if (stickersKey) {
-			ClearKey(stickersKey, _basePath);
-			stickersKey = 0;
-			writeMapDelayed();
-		}
+	if (list.empty() && order.isEmpty()) {
+		clearStickerSets(stickersKey);
 		return;
 	}
-	size += sizeof(qint32) + (order.size() * sizeof(quint64));
 
 	if (!stickersKey) {
 		stickersKey = GenerateKey(_basePath);
 		writeMapQueued();
+	} else if (writeStickerSetsJournal(stickersKey, list, order)) {
+		return;
+	}
+	writeStickerSetsFull(stickersKey, list, order);
+}
+
+void Account::writeStickerSetsFull(
+		FileKey stickersKey,
+		const std::vector<not_null<Data::StickersSet*>> &list,
+		const Data::StickersSetsOrder &order) {
+	// versionTag + version + generation + count
+	auto size = uint32(sizeof(quint32)
+		+ sizeof(qint32)
+		+ sizeof(quint64)
+		+ sizeof(qint32));
+	for (const auto set : list) {
+		size += StickerSetSize(*set);
 	}
+	size += sizeof(qint32) + (order.size() * sizeof(quint64));
+
+	const auto generation = NewJournalGeneration();
 	EncryptedDescriptor data(size);
 	data.stream
 		<< quint32(kStickersVersionTag)
 		<< qint32(kStickersSerializeVersion)
-		<< qint32(setsCount);
-	for (const auto &[id, set] : sets) {
-		auto result = checkSet(*set);
-		if (result == StickerSetCheckResult::Abort) {
-			return;
-		} else if (result == StickerSetCheckResult::Skip) {
-			continue;
-		}
+		<< quint64(generation)
+		<< qint32(list.size());
+	for (const auto set : list) {
 		writeStickerSet(data.stream, *set);
 	}
 	data.stream << order;
+	const auto written = int64(data.data.size());
+	{
+		FileWriteDescriptor file(stickersKey, _basePath);
+		file.writeEncrypted(data, _localKey);
+	}
 
-	FileWriteDescriptor file(stickersKey, _basePath);
-	file.writeEncrypted(data, _localKey);
+	auto &journal = _stickersJournals[stickersKey];
+	if (!journal) {
+		journal = std::make_unique<StickersJournal>();
+	}
+	StartJournal(
+		ToFilePart(stickersKey),
+		_basePath,
+		journal->state,
+		generation,
+		written);
+	journal->sets.clear();
+	for (const auto set : list) {
+		journal->sets.emplace(set->id, StickerSetFingerprint(*set));
+	}
+	journal->order = order;
+}
+
+bool Account::writeStickerSetsJournal(
+		FileKey stickersKey,
+		const std::vector<not_null<Data::StickersSet*>> &list,
+		const Data::StickersSetsOrder &order) {
+	const auto i = _stickersJournals.find(stickersKey);
+	if (i == end(_stickersJournals)) {
+		return false;
+	}
+	auto &journal = *i->second;
+
+	// changedCount + removedCount + hasOrder
+	auto size = uint32(sizeof(quint32) * 2 + sizeof(qint32));
+	auto fingerprints = base::flat_map<uint64, uint64>();
+	auto changed = std::vector<not_null<Data::StickersSet*>>();
+	for (const auto set : list) {
+		const auto fingerprint = StickerSetFingerprint(*set);
+		fingerprints.emplace(set->id, fingerprint);
+		const auto j = journal.sets.find(set->id);
+		if (j == end(journal.sets) || j->second != fingerprint) {
+			changed.push_back(set);
+			size += StickerSetSize(*set);
+		}
+	}
+	auto removed = std::vector<uint64>();
+	for (const auto &[id, fingerprint] : journal.sets) {
+		if (!fingerprints.contains(id)) {
+			removed.push_back(id);
+		}
+	}
+	const auto orderChanged = (order != journal.order);
+	size += removed.size() * sizeof(quint64);
+	if (orderChanged) {
+		size += sizeof(qint32) + (order.size() * sizeof(quint64));
+	}
+	if (!journal.state.canAppend(size)
+		|| (changed.size() > kMaxSavedStickerSetsCount)
+		|| (removed.size() > kMaxSavedStickerSetsCount)) {
+		// Records with more sets than we read back are written in full.
+		return false;
+	} else if (changed.empty() && removed.empty() && !orderChanged) {
+		return true;
+	}
+
+	EncryptedDescriptor data(size);
+	data.stream << quint32(changed.size());
+	for (const auto set : changed) {
+		writeStickerSet(data.stream, *set);
+	}
+	data.stream << quint32(removed.size());
+	for (const auto id : removed) {
+		data.stream << quint64(id);
+	}
+	data.stream << qint32(orderChanged ? 1 : 0);
+	if (orderChanged) {
+		data.stream << order;
+	}
+	AppendToJournal(
+		ToFilePart(stickersKey),
+		_basePath,
+		journal.state,
+		data,
+		_localKey);
+
+	journal.sets = std::move(fingerprints);
+	journal.order = order;
+	return true;
+}
+
+void Account::clearStickerSets(FileKey &stickersKey) {
+	if (stickersKey) {
+		ClearKey(stickersKey, _basePath);
+		_stickersJournals.remove(stickersKey);
+		stickersKey = 0;
+		writeMapDelayed();
+	}
+}
+
+auto Account::readStickerSet(
+	QDataStream &stream,
+	int32 streamVersion,
+	qint32 version,
+	const base::flat_set<uint64> &skip)
+-> std::optional<ReadStickerSetResult> {
+	using SetFlag = Data::StickersSetFlag;
+
+	quint64 setId = 0, setAccessHash = 0, setHash = 0;
+	quint64 setThumbnailDocumentId = 0;
+	QString setTitle, setShortName;
+	qint32 scnt = 0;
+	qint32 setInstallDate = 0;
+	Data::StickersSetFlags setFlags = 0;
+	qint32 setFlagsValue = 0;
+	ImageLocation setThumbnail;
+
+	stream
+		>> setId
+		>> setAccessHash
+		>> setHash
+		>> setTitle
+		>> setShortName
+		>> scnt
+		>> setFlagsValue
+		>> setInstallDate;
+	if (version > 2) {
+		stream >> setThumbnailDocumentId;
+	}
+	const auto thumbnail = Serialize::readImageLocation(
+		streamVersion,
+		stream);
+	if (!thumbnail || !CheckStreamStatus(stream)) {
+		return std::nullopt;
+	} else if (thumbnail->valid() && thumbnail->isLegacy()) {
+		// No thumb_version information in legacy location.
+		return std::nullopt;
+	} else {
+		setThumbnail = *thumbnail;
+	}
+
+	setFlags = Data::StickersSetFlags::from_raw(setFlagsValue);
+	if (setId == Data::Stickers::DefaultSetId) {
+		setTitle = tr::lng_stickers_default_set(tr::now);
+		setFlags |= SetFlag::Official | SetFlag::Special;
+	} else if (setId == Data::Stickers::CustomSetId) {
+		setTitle = u"Custom stickers"_q;
+		setFlags |= SetFlag::Special;
+	} else if ((setId == Data::Stickers::CloudRecentSetId)
+			|| (setId == Data::Stickers::CloudRecentAttachedSetId)) {
+		setTitle = tr::lng_recent_stickers(tr::now);
+		setFlags |= SetFlag::Special;
+	} else if (setId == Data::Stickers::FavedSetId) {
+		setTitle = Lang::Hard::FavedSetTitle();
+		setFlags |= SetFlag::Special;
+	} else if (!setId) {
+		return ReadStickerSetResult();
+	}
+
+	// Sets replaced by newer journal records are read only to be skipped.
+	auto &sets = _owner->session().data().stickers().setsRef();
+	const auto skipped = skip.contains(setId);
+	auto it = skipped ? end(sets) : sets.find(setId);
+	if (!skipped && it == end(sets)) {
+		// We will set this flags from order lists when reading those stickers.
+		setFlags &= ~(SetFlag::Installed | SetFlag::Featured);
+		it = sets.emplace(setId, std::make_unique<Data::StickersSet>(
+			&_owner->session().data(),
+			setId,
+			setAccessHash,
+			setHash,
+			setTitle,
+			setShortName,
+			0,
+			setFlags,
+			setInstallDate)).first;
+		it->second->setThumbnail(
+			ImageWithLocation{ .location = setThumbnail });
+		it->second->thumbnailDocumentId = setThumbnailDocumentId;
+	}
+	const auto set = skipped ? nullptr : it->second.get();
+	const auto fillStickers = set && set->stickers.isEmpty();
+	const auto result = ReadStickerSetResult{
+		.id = setId,
+		.filled = fillStickers,
+	};
+
+	if (scnt < 0) { // disabled not loaded set
+		if (set && (!set->count || fillStickers)) {
+			set->count = -scnt;
+		}
+		return result;
+	}
+
+	if (fillStickers) {
+		set->stickers.reserve(scnt);
+		set->count = 0;
+	}
+
+	Serialize::Document::StickerSetInfo info(
+		setId,
+		setAccessHash,
+		setShortName);
+	base::flat_set<DocumentId> read;
+	for (int32 j = 0; j < scnt; ++j) {
+		auto document = Serialize::Document::readStickerFromStream(
+			&_owner->session(),
+			streamVersion,
+			stream, info);
+		if (!CheckStreamStatus(stream)) {
+			return std::nullopt;
+		} else if (!document
+			|| !document->sticker()
+			|| read.contains(document->id)) {
+			continue;
+		}
+		read.emplace(document->id);
+		if (fillStickers) {
+			set->stickers.push_back(document);
+			if (!(set->flags & SetFlag::Special)) {
+				if (!document->sticker()->set.id) {
+					document->sticker()->set = set->identifier();
+				}
+			}
+			++set->count;
+		}
+	}
+
+	qint32 datesCount = 0;
+	stream >> datesCount;
+	if (datesCount > 0) {
+		if (datesCount != scnt) {
+			return std::nullopt;
+		}
+		const auto fillDates = set
+			&& ((set->id == Data::Stickers::CloudRecentSetId)
+				|| (set->id == Data::Stickers::CloudRecentAttachedSetId))
+			&& (set->stickers.size() == datesCount);
+		if (fillDates) {
+			set->dates.clear();
+			set->dates.reserve(datesCount);
+		}
+		for (auto i = 0; i != datesCount; ++i) {
+			qint32 date = 0;
+			stream >> date;
+			if (fillDates) {
+				set->dates.push_back(TimeId(date));
+			}
+		}
+	}
+
+	qint32 emojiCount = 0;
+	stream >> emojiCount;
+	if (!CheckStreamStatus(stream) || emojiCount < 0) {
+		return std::nullopt;
+	}
+	for (int32 j = 0; j < emojiCount; ++j) {
+		QString emojiString;
+		qint32 stickersCount;
+		stream >> emojiString >> stickersCount;
+		Data::StickersPack pack;
+		pack.reserve(stickersCount);
+		for (int32 k = 0; k < stickersCount; ++k) {
+			quint64 id;
+			stream >> id;
+			const auto doc = _owner->session().data().document(id);
+			if (!doc->sticker()) continue;
+
+			pack.push_back(doc);
+		}
+		if (fillStickers) {
+			if (auto emoji = Ui::Emoji::Find(emojiString)) {
+				emoji = emoji->original();
+				set->emoji[emoji] = std::move(pack);
+			}
+		}
+	}
+	return result;
 }
 
 void Account::readStickerSets(
@@ -1771,6 +2246,7 @@ void Account::readStickerSets(
 	FileReadDescriptor stickers;
 	if (!ReadEncryptedFile(stickers, stickersKey, _basePath, _localKey)) {
 		ClearKey(stickersKey, _basePath);
+		_stickersJournals.remove(stickersKey);
 		stickersKey = 0;
 		writeMapDelayed();
 		return;
@@ -1778,6 +2254,7 @@ void Account::readStickerSets(
 
 	const auto failed = [&] {
 		ClearKey(stickersKey, _basePath);
+		_stickersJournals.remove(stickersKey);
 		stickersKey = 0;
 	};
 
@@ -1788,10 +2265,16 @@ void Account::readStickerSets(
 	qint32 version = 0;
 	stickers.stream >> versionTag >> version;
 	if (versionTag != kStickersVersionTag
-		|| (version != 2 && version != kStickersSerializeVersion)) {
+		|| (version != 2
+			&& version != 3
+			&& version != kStickersSerializeVersion)) {
 		// Old data, without sticker set thumbnails.
 		return failed();
 	}
+	quint64 generation = 0;
+	if (version > 3) {
+		stickers.stream >> generation;
+	}
 	qint32 count = 0;
 	stickers.stream >> count;
 	if (!CheckStreamStatus(stickers.stream)
@@ -1799,174 +2282,101 @@ void Account::readStickerSets(
 		|| (count > kMaxSavedStickerSetsCount)) {
 		return failed();
 	}
-	for (auto i = 0; i != count; ++i) {
-		quint64 setId = 0, setAccessHash = 0, setHash = 0;
-		quint64 setThumbnailDocumentId = 0;
-		QString setTitle, setShortName;
-		qint32 scnt = 0;
-		qint32 setInstallDate = 0;
-		Data::StickersSetFlags setFlags = 0;
-		qint32 setFlagsValue = 0;
-		ImageLocation setThumbnail;
-
-		stickers.stream
-			>> setId
-			>> setAccessHash
-			>> setHash
-			>> setTitle
-			>> setShortName
-			>> scnt
-			>> setFlagsValue
-			>> setInstallDate;
-		if (version > 2) {
-			stickers.stream >> setThumbnailDocumentId;
-		}
-		const auto thumbnail = Serialize::readImageLocation(
-			stickers.version,
-			stickers.stream);
-		if (!thumbnail || !CheckStreamStatus(stickers.stream)) {
-			return failed();
-		} else if (thumbnail->valid() && thumbnail->isLegacy()) {
-			// No thumb_version information in legacy location.
-			return failed();
-		} else {
-			setThumbnail = *thumbnail;
-		}
-
-		setFlags = Data::StickersSetFlags::from_raw(setFlagsValue);
-		if (setId == Data::Stickers::DefaultSetId) {
-			setTitle = tr::lng_stickers_default_set(tr::now);
-			setFlags |= SetFlag::Official | SetFlag::Special;
-		} else if (setId == Data::Stickers::CustomSetId) {
-			setTitle = u"Custom stickers"_q;
-			setFlags |= SetFlag::Special;
-		} else if ((setId == Data::Stickers::CloudRecentSetId)
-				|| (setId == Data::Stickers::CloudRecentAttachedSetId)) {
-			setTitle = tr::lng_recent_stickers(tr::now);
-			setFlags |= SetFlag::Special;
-		} else if (setId == Data::Stickers::FavedSetId) {
-			setTitle = Lang::Hard::FavedSetTitle();
-			setFlags |= SetFlag::Special;
-		} else if (!setId) {
-			continue;
-		}
 
-		auto it = sets.find(setId);
-		if (it == sets.cend()) {
-			// We will set this flags from order lists when reading those stickers.
-			setFlags &= ~(SetFlag::Installed | SetFlag::Featured);
-			it = sets.emplace(setId, std::make_unique<Data::StickersSet>(
-				&_owner->session().data(),
-				setId,
-				setAccessHash,
-				setHash,
-				setTitle,
-				setShortName,
-				0,
-				setFlags,
-				setInstallDate)).first;
-			it->second->setThumbnail(
-				ImageWithLocation{ .location = setThumbnail });
-			it->second->thumbnailDocumentId = setThumbnailDocumentId;
-		}
-		const auto set = it->second.get();
-		const auto inputSet = set->identifier();
-		const auto fillStickers = set->stickers.isEmpty();
-
-		if (scnt < 0) { // disabled not loaded set
-			if (!set->count || fillStickers) {
-				set->count = -scnt;
+	auto journal = std::make_unique<StickersJournal>();
+	journal->state = JournalState{
+		.generation = generation,
+		.baseSize = stickers.data.size(),
+	};
+	auto records = std::vector<std::pair<QByteArray, int32>>();
+	ReadJournal(
+		ToFilePart(stickersKey),
+		_basePath,
+		journal->state,
+		_localKey,
+		[&](EncryptedDescriptor &record, int32 version) {
+			records.emplace_back(record.data, version);
+			return true;
+		});
+
+	// Newer records replace the sets from older ones and from the base.
+	auto handled = base::flat_set<uint64>();
+	auto present = base::flat_set<uint64>();
+	auto filled = base::flat_set<uint64>();
+	auto order = std::optional<Data::StickersSetsOrder>();
+	const auto readSet = [&](
+			QDataStream &stream,
+			int32 streamVersion,
+			qint32 version) {
+		const auto result = readStickerSet(
+			stream,
+			streamVersion,
+			version,
+			handled);
+		if (!result) {
+			return false;
+		} else if (result->id && !handled.contains(result->id)) {
+			handled.emplace(result->id);
+			present.emplace(result->id);
+			if (result->filled) {
+				filled.emplace(result->id);
 			}
-			continue;
 		}
-
-		if (fillStickers) {
-			set->stickers.reserve(scnt);
-			set->count = 0;
+		return true;
+	};
+	for (auto &[data, streamVersion] : ranges::views::reverse(records)) {
+		QBuffer buffer(&data);
+		buffer.open(QIODevice::ReadOnly);
+		buffer.seek(sizeof(uint32)); // skip len
+		QDataStream stream(&buffer);
+		stream.setVersion(QDataStream::Qt_5_1);
+
+		quint32 changedCount = 0;
+		stream >> changedCount;
+		if (!CheckStreamStatus(stream)
+			|| (changedCount > kMaxSavedStickerSetsCount)) {
+			return failed();
 		}
-
-		Serialize::Document::StickerSetInfo info(
-			setId,
-			setAccessHash,
-			setShortName);
-		base::flat_set<DocumentId> read;
-		for (int32 j = 0; j < scnt; ++j) {
-			auto document = Serialize::Document::readStickerFromStream(
-				&_owner->session(),
-				stickers.version,
-				stickers.stream, info);
-			if (!CheckStreamStatus(stickers.stream)) {
+		for (auto i = quint32(); i != changedCount; ++i) {
+			if (!readSet(stream, streamVersion, kStickersSerializeVersion)) {
 				return failed();
-			} else if (!document
-				|| !document->sticker()
-				|| read.contains(document->id)) {
-				continue;
-			}
-			read.emplace(document->id);
-			if (fillStickers) {
-				set->stickers.push_back(document);
-				if (!(set->flags & SetFlag::Special)) {
-					if (!document->sticker()->set.id) {
-						document->sticker()->set = inputSet;
-					}
-				}
-				++set->count;
 			}
 		}
-
-		qint32 datesCount = 0;
-		stickers.stream >> datesCount;
-		if (datesCount > 0) {
-			if (datesCount != scnt) {
-				return failed();
-			}
-			const auto fillDates =
-				((set->id == Data::Stickers::CloudRecentSetId)
-					|| (set->id == Data::Stickers::CloudRecentAttachedSetId))
-				&& (set->stickers.size() == datesCount);
-			if (fillDates) {
-				set->dates.clear();
-				set->dates.reserve(datesCount);
-			}
-			for (auto i = 0; i != datesCount; ++i) {
-				qint32 date = 0;
-				stickers.stream >> date;
-				if (fillDates) {
-					set->dates.push_back(TimeId(date));
-				}
+		quint32 removedCount = 0;
+		stream >> removedCount;
+		if (!CheckStreamStatus(stream)
+			|| (removedCount > kMaxSavedStickerSetsCount)) {
+			return failed();
+		}
+		for (auto i = quint32(); i != removedCount; ++i) {
+			quint64 id = 0;
+			stream >> id;
+			handled.emplace(id);
+		}
+		qint32 hasOrder = 0;
+		stream >> hasOrder;
+		if (hasOrder) {
+			auto value = Data::StickersSetsOrder();
+			stream >> value;
+			if (!order) {
+				order = std::move(value);
 			}
 		}
-
-		qint32 emojiCount = 0;
-		stickers.stream >> emojiCount;
-		if (!CheckStreamStatus(stickers.stream) || emojiCount < 0) {
+		if (!CheckStreamStatus(stream)) {
 			return failed();
 		}
-		for (int32 j = 0; j < emojiCount; ++j) {
-			QString emojiString;
-			qint32 stickersCount;
-			stickers.stream >> emojiString >> stickersCount;
-			Data::StickersPack pack;
-			pack.reserve(stickersCount);
-			for (int32 k = 0; k < stickersCount; ++k) {
-				quint64 id;
-				stickers.stream >> id;
-				const auto doc = _owner->session().data().document(id);
-				if (!doc->sticker()) continue;
-
-				pack.push_back(doc);
-			}
-			if (fillStickers) {
-				if (auto emoji = Ui::Emoji::Find(emojiString)) {
-					emoji = emoji->original();
-					set->emoji[emoji] = std::move(pack);
-				}
-			}
+	}
+
+	for (auto i = 0; i != count; ++i) {
+		if (!readSet(stickers.stream, stickers.version, version)) {
+			return failed();
 		}
 	}
 
 	// Read orders of installed and featured stickers.
-	if (outOrder) {
+	if (outOrder && order) {
+		*outOrder = std::move(*order);
+	} else if (outOrder) {
 		auto outOrderCount = quint32();
 		stickers.stream >> outOrderCount;
 		if (!CheckStreamStatus(stickers.stream) || outOrderCount > 1000) {
@@ -2001,6 +2411,24 @@ void Account::readStickerSets(
 			}
 		}
 	}
+
+	if (!journal->state.generation) {
+		_stickersJournals.remove(stickersKey);
+		return;
+	}
+	// Sets that were not filled from this file will be rewritten.
+	for (const auto id : present) {
+		const auto i = sets.find(id);
+		journal->sets.emplace(
+			id,
+			((i != end(sets)) && filled.contains(id)
+				? StickerSetFingerprint(*i->second)
+				: 0));
+	}
+	if (outOrder) {
+		journal->order = *outOrder;
+	}
+	_stickersJournals[stickersKey] = std::move(journal);
 }
 
 void Account::writeInstalledStickers() {
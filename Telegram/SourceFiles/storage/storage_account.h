@@ -67,6 +67,9 @@ public:
 	~Account();
 
 	[[nodiscard]] StartResult legacyStart(const QByteArray &passcode);
+
+	// Starts reading the files needed by start() on background threads.
+	void preload(const MTP::AuthKeyPtr &localKey);
 	[[nodiscard]] std::unique_ptr<MTP::Config> start(
 		MTP::AuthKeyPtr localKey);
 	void startAdded(MTP::AuthKeyPtr localKey);
@@ -178,6 +181,12 @@ public:
 	void reset();
 
 private:
+	struct MapJournal;
+	struct StickersJournal;
+	struct ReadStickerSetResult {
+		uint64 id = 0;
+		bool filled = false;
+	};
 	enum class ReadMapResult {
 		Success,
 		IncorrectPasscode,
@@ -201,6 +210,8 @@ private:
 	void writeMapDelayed();
 	void writeMapQueued();
 	void writeMap();
+	[[nodiscard]] QByteArray serializeMapKeys(const QByteArray &self) const;
+	[[nodiscard]] bool writeMapJournal();
 
 	void readLocations();
 	void writeLocations();
@@ -235,6 +246,20 @@ private:
 		FileKey &stickersKey,
 		CheckSet checkSet,
 		const Data::StickersSetsOrder &order);
+	void writeStickerSetsFull(
+		FileKey stickersKey,
+		const std::vector<not_null<Data::StickersSet*>> &list,
+		const Data::StickersSetsOrder &order);
+	[[nodiscard]] bool writeStickerSetsJournal(
+		FileKey stickersKey,
+		const std::vector<not_null<Data::StickersSet*>> &list,
+		const Data::StickersSetsOrder &order);
+	void clearStickerSets(FileKey &stickersKey);
+	[[nodiscard]] std::optional<ReadStickerSetResult> readStickerSet(
+		QDataStream &stream,
+		int32 streamVersion,
+		qint32 version,
+		const base::flat_set<uint64> &skip);
 	void readStickerSets(
 		FileKey &stickersKey,
 		Data::StickersSetsOrder *outOrder = nullptr,
@@ -304,6 +329,9 @@ private:
 
 	int _oldMapVersion = 0;
 
+	const std::unique_ptr<MapJournal> _mapJournal;
+	base::flat_map<FileKey, std::unique_ptr<StickersJournal>> _stickersJournals;
+
 	base::Timer _writeMapTimer;
 	base::Timer _writeLocationsTimer;
 	bool _mapChanged = false;
@@ -115,6 +115,7 @@ void Domain::encryptLocalKey(const QByteArray &passcode) {
 
 Domain::StartModernResult Domain::startModern(
 		const QByteArray &passcode) {
+	const auto started = crl::now();
 	const auto name = ComputeKeyName(_dataName);
 
 	FileReadDescriptor keyData;
@@ -133,7 +134,9 @@ Domain::StartModernResult Domain::startModern(
 		LOG(("App Error: bad salt in info file, size: %1").arg(salt.size()));
 		return StartModernResult::Failed;
 	}
+	const auto keyStarted = crl::now();
 	_passcodeKey = CreateLocalKey(passcode, salt);
+	_startTimings.passcodeKey = crl::now() - keyStarted;
 
 	EncryptedDescriptor keyInnerData, info;
 	if (!DecryptLocal(keyInnerData, keyEncrypted, _passcodeKey)) {
@@ -167,19 +170,54 @@ Domain::StartModernResult Domain::startModern(
 
 	_oldVersion = keyData.version;
 
-	auto tried = base::flat_set<int>();
-	auto sessions = base::flat_set<uint64>();
-	auto active = 0;
+	auto indices = std::vector<int>();
+	indices.reserve(count);
 	for (auto i = 0; i != count; ++i) {
 		auto index = qint32();
 		info.stream >> index;
-		if (index >= 0
+		indices.push_back(index);
+	}
+	auto storedActive = std::optional<int>();
+	if (!info.stream.atEnd()) {
+		auto index = qint32();
+		info.stream >> index;
+		storedActive = index;
+	}
+	_startTimings.info = crl::now() - started - _startTimings.passcodeKey;
+
+	auto tried = base::flat_set<int>();
+	auto accounts = std::vector<std::unique_ptr<Main::Account>>();
+	accounts.reserve(count);
+	for (const auto index : indices) {
+		accounts.push_back((index >= 0
 			&& index < Main::Domain::kMaxAccounts
-			&& tried.emplace(index).second) {
-			auto account = std::make_unique<Main::Account>(
-				_owner,
-				_dataName,
-				index);
+			&& tried.emplace(index).second)
+			? std::make_unique<Main::Account>(_owner, _dataName, index)
+			: nullptr);
+	}
+
+	// Files of all the accounts are read and decrypted in parallel,
+	// the files of the active account are requested first.
+	for (auto i = 0; i != count; ++i) {
+		if (accounts[i] && storedActive == indices[i]) {
+			accounts[i]->local().preload(_localKey);
+		}
+	}
+	for (auto i = 0; i != count; ++i) {
+		if (accounts[i] && storedActive != indices[i]) {
+			accounts[i]->local().preload(_localKey);
+		}
+	}
+
+	auto sessions = base::flat_set<uint64>();
+	auto active = 0;
+	for (auto i = 0; i != count; ++i) {
+		const auto index = indices[i];
+		if (auto account = std::move(accounts[i])) {
+			const auto accountStarted = crl::now();
+			const auto isActive = storedActive
+				? (*storedActive == index)
+				: sessions.empty();
 			auto config = account->prepareToStart(_localKey);
 			const auto sessionId = account->willHaveSessionUniqueId(
 				config.get());
@@ -195,6 +233,9 @@ Domain::StartModernResult Domain::startModern(
 				});
 				sessions.emplace(sessionId);
 			}
+			(isActive
+				? _startTimings.activeAccount
+				: _startTimings.otherAccounts) += crl::now() - accountStarted;
 		}
 	}
 	if (sessions.empty()) {
@@ -202,9 +243,20 @@ Domain::StartModernResult Domain::startModern(
 		return StartModernResult::Failed;
 	}
 
-	if (!info.stream.atEnd()) {
-		info.stream >> active;
+	if (storedActive) {
+		active = *storedActive;
 	}
+	_startTimings.total = crl::now() - started;
+	_startTimings.accounts = int(sessions.size());
+	LOG(("App Info: %1 accounts started in %2 ms "
+		"(passcode key %3 ms, info %4 ms, active %5 ms, others %6 ms)."
+		).arg(_startTimings.accounts
+		).arg(_startTimings.total
+		).arg(_startTimings.passcodeKey
+		).arg(_startTimings.info
+		).arg(_startTimings.activeAccount
+		).arg(_startTimings.otherAccounts));
+
 	_owner->activateFromStorage(active);
 
 	Ensures(!sessions.empty());
@@ -280,4 +332,8 @@ bool Domain::hasLocalPasscode() const {
 	return _hasLocalPasscode;
 }
 
+const StartTimings &Domain::startTimings() const {
+	return _startTimings;
+}
+
 } // namespace Storage
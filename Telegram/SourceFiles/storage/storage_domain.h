@@ -26,6 +26,16 @@ enum class StartResult : uchar {
 	IncorrectPasscodeLegacy,
 };
 
+// Durations of the startup phases, to follow the cold start latency.
+struct StartTimings {
+	crl::time passcodeKey = 0;
+	crl::time info = 0;
+	crl::time activeAccount = 0;
+	crl::time otherAccounts = 0;
+	crl::time total = 0;
+	int accounts = 0;
+};
+
 class Domain final {
 public:
 	Domain(not_null<Main::Domain*> owner, const QString &dataName);
@@ -49,6 +59,8 @@ public:
 	[[nodiscard]] rpl::producer<> localPasscodeChanged() const;
 	[[nodiscard]] bool hasLocalPasscode() const;
 
+	[[nodiscard]] const StartTimings &startTimings() const;
+
 private:
 	enum class StartModernResult {
 		Success,
@@ -72,6 +84,7 @@ private:
 	QByteArray _passcodeKeySalt;
 	QByteArray _passcodeKeyEncrypted;
 	int _oldVersion = 0;
+	StartTimings _startTimings;
 
 	bool _hasLocalPasscode = false;
 	rpl::event_stream<> _passcodeKeyChanged;
@@ -0,0 +1,506 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_history_cache.h"
+
+#include "storage/cache/storage_cache_database.h"
+#include "data/data_session.h"
+#include "data/data_channel.h"
+#include "history/history.h"
+#include "core/version.h"
+#include "base/unixtime.h"
+
+#include <QtCore/QBuffer>
+
+namespace Storage {
+namespace {
+
+constexpr auto kFormatVersion = 1;
+constexpr auto kMaxEntries = 64;
+constexpr auto kPreloadEntries = 8;
+constexpr auto kMaxMessagesInSlice = 100;
+constexpr auto kMaxSliceSize = 1024 * 1024;
+constexpr auto kMaxEntryAge = 7 * 86400;
+constexpr auto kWriteIndexTimeout = 3 * crl::time(1000);
+
+[[nodiscard]] Cache::Key IndexKey() {
+	return Data::HistorySliceCacheKey(PeerId());
+}
+
+template <typename Entity>
+[[nodiscard]] uint64 EntityId(const Entity &entity) {
+	return entity.match([](const auto &data) {
+		return uint64(data.vid().v);
+	}) ^ (uint64(entity.type()) << 32);
+}
+
+[[nodiscard]] PeerId PeerFromEntity(const MTPUser &user) {
+	return user.match([](const auto &data) {
+		return peerFromUser(data.vid());
+	});
+}
+
+[[nodiscard]] PeerId PeerFromEntity(const MTPChat &chat) {
+	return chat.match([](const MTPDchannel &data) {
+		return peerFromChannel(data.vid());
+	}, [](const MTPDchannelForbidden &data) {
+		return peerFromChannel(data.vid());
+	}, [](const auto &data) {
+		return peerFromChat(data.vid());
+	});
+}
+
+// Peers already in memory are newer than the ones stored with a slice.
+template <typename Entity>
+[[nodiscard]] QVector<Entity> FilterUnknown(
+		not_null<Data::Session*> owner,
+		const QVector<Entity> &list) {
+	auto result = QVector<Entity>();
+	result.reserve(list.size());
+	for (const auto &entity : list) {
+		if (!owner->peerLoaded(PeerFromEntity(entity))) {
+			result.push_back(entity);
+		}
+	}
+	return result;
+}
+
+template <typename Entity>
+void AppendMissing(QVector<Entity> &to, const QVector<Entity> &from) {
+	auto known = base::flat_set<uint64>();
+	known.reserve(to.size());
+	for (const auto &entity : to) {
+		known.emplace(EntityId(entity));
+	}
+	for (const auto &entity : from) {
+		if (known.emplace(EntityId(entity)).second) {
+			to.push_back(entity);
+		}
+	}
+}
+
+} // namespace
+
+HistoryCache::HistoryCache(not_null<Data::Session*> owner)
+: _owner(owner)
+, _writeIndexTimer([=] { writeIndex(); }) {
+	_owner->historyCleared(
+	) | rpl::start_with_next([=](not_null<const History*> history) {
+		invalidate(history->peer->id);
+	}, _lifetime);
+
+	_owner->channelDifferenceTooLong(
+	) | rpl::start_with_next([=](not_null<ChannelData*> channel) {
+		invalidate(channel->id);
+	}, _lifetime);
+}
+
+HistoryCache::~HistoryCache() {
+	if (_writeIndexTimer.isActive()) {
+		writeIndex();
+	}
+}
+
+void HistoryCache::preload() {
+	const auto weak = base::make_weak(this);
+	_owner->cache().get(IndexKey(), [=](QByteArray &&value) {
+		crl::on_main(weak, [=, serialized = std::move(value)] {
+			readIndex(serialized);
+			preloadSlices();
+		});
+	});
+}
+
+void HistoryCache::readIndex(const QByteArray &serialized) {
+	_indexRead = true;
+	const auto pending = base::take(_pendingInvalidations);
+	if (serialized.isEmpty()) {
+		return;
+	}
+	auto stream = QDataStream(serialized);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto version = qint32();
+	auto appVersion = qint32();
+	auto count = qint32();
+	stream >> version >> appVersion >> count;
+	if (stream.status() != QDataStream::Ok
+		|| version != kFormatVersion
+		|| appVersion != AppVersion
+		|| count < 0
+		|| count > kMaxEntries) {
+		// Serialized messages may not be readable by another scheme layer.
+		_owner->cache().remove(IndexKey());
+		return;
+	}
+	const auto now = base::unixtime::now();
+	auto entries = std::vector<Entry>();
+	entries.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		auto peerId = quint64();
+		auto minId = qint64();
+		auto maxId = qint64();
+		auto saved = qint32();
+		stream >> peerId >> minId >> maxId >> saved;
+		if (stream.status() != QDataStream::Ok) {
+			return;
+		} else if (saved + kMaxEntryAge < now) {
+			const auto key = Data::HistorySliceCacheKey(PeerId(peerId));
+			_owner->cache().remove(key);
+			writeIndexDelayed();
+			continue;
+		}
+		entries.push_back({
+			.peerId = PeerId(peerId),
+			.minId = minId,
+			.maxId = maxId,
+			.saved = saved,
+		});
+	}
+
+	// Entries stored before the index was read go first.
+	for (auto &entry : entries) {
+		if (ranges::contains(_entries, entry.peerId, &Entry::peerId)) {
+			continue;
+		}
+		const auto invalidated = ranges::any_of(pending, [&](
+				const Fn<bool(const Entry&)> &condition) {
+			return condition(entry);
+		});
+		if (invalidated) {
+			const auto key = Data::HistorySliceCacheKey(entry.peerId);
+			_owner->cache().remove(key);
+			writeIndexDelayed();
+		} else {
+			_entries.push_back(entry);
+		}
+	}
+	while (_entries.size() > kMaxEntries) {
+		remove(end(_entries) - 1);
+		writeIndexDelayed();
+	}
+}
+
+void HistoryCache::preloadSlices() {
+	const auto weak = base::make_weak(this);
+	const auto count = std::min(int(_entries.size()), kPreloadEntries);
+	for (auto i = 0; i != count; ++i) {
+		const auto peerId = _entries[i].peerId;
+		const auto key = Data::HistorySliceCacheKey(peerId);
+		_owner->cache().get(key, [=](QByteArray &&value) {
+			crl::on_main(weak, [=, serialized = std::move(value)] {
+				slicePreloaded(peerId, serialized);
+			});
+		});
+	}
+}
+
+void HistoryCache::slicePreloaded(
+		PeerId peerId,
+		const QByteArray &serialized) {
+	if (!ranges::contains(_entries, peerId, &Entry::peerId)
+		|| _shown.contains(peerId)
+		|| (_owner->historyLoaded(peerId)
+			&& !_owner->historyLoaded(peerId)->isEmpty())) {
+		return;
+	} else if (auto slice = DeserializeSlice(serialized)) {
+		_preloaded[peerId] = std::move(*slice);
+	} else {
+		invalidate(peerId);
+	}
+}
+
+std::optional<MTPmessages_Messages> HistoryCache::take(PeerId peerId) {
+	auto slice = _preloaded.take(peerId);
+	if (!slice || slice->messages.isEmpty()) {
+		return std::nullopt;
+	}
+	auto result = MTP_messages_messages(
+		MTP_vector<MTPMessage>(slice->messages),
+		MTP_vector<MTPChat>(FilterUnknown(_owner, slice->chats)),
+		MTP_vector<MTPUser>(FilterUnknown(_owner, slice->users)));
+	_unvalidated[peerId] = ranges::views::all(
+		slice->messages
+	) | ranges::views::transform(IdFromMessage) | ranges::to_vector;
+	_shown[peerId] = std::move(*slice);
+	return result;
+}
+
+void HistoryCache::store(
+		not_null<History*> history,
+		const MTPmessages_Messages &result) {
+	const auto peerId = history->peer->id;
+	_preloaded.remove(peerId);
+	_shown.remove(peerId);
+	auto slice = ParseResult(result);
+	if (slice.messages.isEmpty()) {
+		invalidate(peerId);
+		return;
+	}
+	write(peerId, std::move(slice));
+}
+
+void HistoryCache::validate(
+		not_null<History*> history,
+		const MTPmessages_Messages &result) {
+	const auto peerId = history->peer->id;
+	const auto shownIds = _unvalidated.take(peerId);
+	if (!shownIds || result.type() == mtpc_messages_messagesNotModified) {
+		return;
+	}
+	const auto fresh = ParseResult(result);
+	_owner->processUsers(MTP_vector<MTPUser>(fresh.users));
+	_owner->processChats(MTP_vector<MTPChat>(fresh.chats));
+
+	auto freshIds = base::flat_set<MsgId>();
+	freshIds.reserve(fresh.messages.size());
+	for (const auto &message : fresh.messages) {
+		freshIds.emplace(IdFromMessage(message));
+		_owner->updateEditedMessage(message);
+	}
+
+	// Everything from the oldest fresh message up was returned, so cached
+	// messages in that range missing from the result were deleted.
+	const auto freshMin = freshIds.empty() ? MsgId() : freshIds.front();
+	auto deleted = QVector<MTPint>();
+	for (const auto id : *shownIds) {
+		if (id >= freshMin && !freshIds.contains(id)) {
+			deleted.push_back(MTP_int(id.bare));
+		}
+	}
+	if (!deleted.isEmpty()) {
+		_owner->processMessagesDeleted(peerId, deleted);
+	}
+	store(history, result);
+}
+
+void HistoryCache::storeNewer(
+		not_null<History*> history,
+		const MTPmessages_Messages &result) {
+	const auto peerId = history->peer->id;
+	const auto i = _shown.find(peerId);
+	if (i == end(_shown)) {
+		return;
+	} else if (!history->loadedAtBottom()) {
+		// There still is a gap between the slice and the chat bottom.
+		return;
+	}
+	auto merged = MergeNewer(std::move(i->second), ParseResult(result));
+	_shown.erase(i);
+	write(peerId, std::move(merged));
+}
+
+void HistoryCache::write(PeerId peerId, Slice &&slice) {
+	if (slice.messages.size() > kMaxMessagesInSlice) {
+		slice.messages.resize(kMaxMessagesInSlice);
+	}
+	auto serialized = SerializeSlice(slice);
+	if (serialized.size() > kMaxSliceSize) {
+		invalidate(peerId);
+		return;
+	}
+	const auto ids = ranges::views::all(
+		slice.messages
+	) | ranges::views::transform(IdFromMessage);
+	const auto [min, max] = ranges::minmax(ids);
+
+	const auto i = ranges::find(_entries, peerId, &Entry::peerId);
+	if (i != end(_entries)) {
+		_entries.erase(i);
+	}
+	_entries.insert(begin(_entries), Entry{
+		.peerId = peerId,
+		.minId = min,
+		.maxId = max,
+		.saved = base::unixtime::now(),
+	});
+	while (_entries.size() > kMaxEntries) {
+		remove(end(_entries) - 1);
+	}
+	_owner->cache().put(
+		Data::HistorySliceCacheKey(peerId),
+		std::move(serialized));
+	writeIndexDelayed();
+}
+
+void HistoryCache::invalidate(PeerId peerId) {
+	if (!_indexRead) {
+		_pendingInvalidations.push_back([=](const Entry &entry) {
+			return (entry.peerId == peerId);
+		});
+	}
+	forget(peerId);
+}
+
+void HistoryCache::forget(PeerId peerId) {
+	_preloaded.remove(peerId);
+	_shown.remove(peerId);
+	const auto i = ranges::find(_entries, peerId, &Entry::peerId);
+	if (i != end(_entries)) {
+		remove(i);
+		writeIndexDelayed();
+	}
+}
+
+void HistoryCache::invalidateEdited(const MTPMessage &message) {
+	const auto peerId = PeerFromMessage(message);
+	const auto id = IdFromMessage(message);
+	invalidateIf([=](const Entry &entry) {
+		return (entry.peerId == peerId)
+			&& (entry.minId <= id)
+			&& (entry.maxId >= id);
+	});
+}
+
+void HistoryCache::invalidateDeleted(
+		PeerId peerId,
+		const QVector<MTPint> &ids) {
+	invalidateIf([=](const Entry &entry) {
+		return (entry.peerId == peerId) && ranges::any_of(ids, [&](
+				const MTPint &id) {
+			return (entry.minId <= id.v) && (entry.maxId >= id.v);
+		});
+	});
+}
+
+void HistoryCache::invalidateNonChannelDeleted(const QVector<MTPint> &ids) {
+	// Ids are unique among all non-channel chats of the account.
+	invalidateIf([=](const Entry &entry) {
+		return !peerIsChannel(entry.peerId) && ranges::any_of(ids, [&](
+				const MTPint &id) {
+			return (entry.minId <= id.v) && (entry.maxId >= id.v);
+		});
+	});
+}
+
+void HistoryCache::invalidateIf(Fn<bool(const Entry&)> condition) {
+	if (!_indexRead) {
+		// Applied to the stored entries when the index is read.
+		_pendingInvalidations.push_back(condition);
+	}
+	auto peers = std::vector<PeerId>();
+	for (const auto &entry : _entries) {
+		if (condition(entry)) {
+			peers.push_back(entry.peerId);
+		}
+	}
+	for (const auto peerId : peers) {
+		forget(peerId);
+	}
+}
+
+void HistoryCache::remove(std::vector<Entry>::iterator i) {
+	_owner->cache().remove(Data::HistorySliceCacheKey(i->peerId));
+	_entries.erase(i);
+}
+
+void HistoryCache::writeIndexDelayed() {
+	if (!_writeIndexTimer.isActive()) {
+		_writeIndexTimer.callOnce(kWriteIndexTimeout);
+	}
+}
+
+void HistoryCache::writeIndex() {
+	if (!_indexRead) {
+		// Don't overwrite the stored index before it was merged with ours.
+		writeIndexDelayed();
+		return;
+	}
+	_writeIndexTimer.cancel();
+	if (_entries.empty()) {
+		_owner->cache().remove(IndexKey());
+	} else {
+		_owner->cache().put(IndexKey(), serializeIndex());
+	}
+}
+
+QByteArray HistoryCache::serializeIndex() const {
+	auto result = QByteArray();
+	auto buffer = QBuffer(&result);
+	buffer.open(QIODevice::WriteOnly);
+	auto stream = QDataStream(&buffer);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream
+		<< qint32(kFormatVersion)
+		<< qint32(AppVersion)
+		<< qint32(_entries.size());
+	for (const auto &entry : _entries) {
+		stream
+			<< quint64(entry.peerId.value)
+			<< qint64(entry.minId.bare)
+			<< qint64(entry.maxId.bare)
+			<< qint32(entry.saved);
+	}
+	return result;
+}
+
+HistoryCache::Slice HistoryCache::ParseResult(
+		const MTPmessages_Messages &result) {
+	return result.match([](const MTPDmessages_messagesNotModified &) {
+		return Slice();
+	}, [](const auto &data) {
+		return Slice{
+			.messages = data.vmessages().v,
+			.chats = data.vchats().v,
+			.users = data.vusers().v,
+		};
+	});
+}
+
+QByteArray HistoryCache::SerializeSlice(const Slice &slice) {
+	auto buffer = mtpBuffer();
+	buffer.push_back(mtpPrime(kFormatVersion));
+	buffer.push_back(mtpPrime(AppVersion));
+	MTP_messages_messages(
+		MTP_vector<MTPMessage>(slice.messages),
+		MTP_vector<MTPChat>(slice.chats),
+		MTP_vector<MTPUser>(slice.users)
+	).write(buffer);
+	return QByteArray(
+		reinterpret_cast<const char*>(buffer.constData()),
+		buffer.size() * sizeof(mtpPrime));
+}
+
+auto HistoryCache::DeserializeSlice(const QByteArray &serialized)
+-> std::optional<Slice> {
+	if (serialized.size() % sizeof(mtpPrime)) {
+		return std::nullopt;
+	}
+	auto from = reinterpret_cast<const mtpPrime*>(serialized.constData());
+	const auto end = from + (serialized.size() / sizeof(mtpPrime));
+	if (end - from < 2
+		|| from[0] != mtpPrime(kFormatVersion)
+		|| from[1] != mtpPrime(AppVersion)) {
+		return std::nullopt;
+	}
+	from += 2;
+	auto result = MTPmessages_Messages();
+	if (!result.read(from, end) || from != end) {
+		return std::nullopt;
+	}
+	return ParseResult(result);
+}
+
+HistoryCache::Slice HistoryCache::MergeNewer(Slice &&older, Slice &&newer) {
+	if (newer.messages.isEmpty()) {
+		return std::move(older);
+	}
+	const auto ids = ranges::views::all(
+		newer.messages
+	) | ranges::views::transform(IdFromMessage);
+	const auto newerMin = ranges::min(ids);
+	for (const auto &message : older.messages) {
+		if (IdFromMessage(message) < newerMin) {
+			newer.messages.push_back(message);
+		}
+	}
+	AppendMissing(newer.chats, older.chats);
+	AppendMissing(newer.users, older.users);
+	return std::move(newer);
+}
+
+} // namespace Storage
@@ -0,0 +1,103 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/timer.h"
+#include "base/weak_ptr.h"
+
+class History;
+
+namespace Data {
+class Session;
+} // namespace Data
+
+namespace Storage {
+
+// Keeps the newest slice of recently opened chats in the encrypted
+// cache database, so after a restart the chat is shown at once and
+// only the messages that came after the slice are requested.
+class HistoryCache final : public base::has_weak_ptr {
+public:
+	explicit HistoryCache(not_null<Data::Session*> owner);
+	~HistoryCache();
+
+	// Reads the index and the most recently stored slices to memory.
+	void preload();
+
+	[[nodiscard]] std::optional<MTPmessages_Messages> take(PeerId peerId);
+
+	// Replaces the stored slice with the newest messages of the chat.
+	void store(
+		not_null<History*> history,
+		const MTPmessages_Messages &result);
+
+	// Applies the newest messages from the server to the ones shown
+	// from a slice returned by take() and replaces the stored slice.
+	void validate(
+		not_null<History*> history,
+		const MTPmessages_Messages &result);
+
+	// Appends messages loaded after a slice returned by take().
+	void storeNewer(
+		not_null<History*> history,
+		const MTPmessages_Messages &result);
+
+	void invalidate(PeerId peerId);
+	void invalidateEdited(const MTPMessage &message);
+	void invalidateDeleted(PeerId peerId, const QVector<MTPint> &ids);
+	void invalidateNonChannelDeleted(const QVector<MTPint> &ids);
+
+private:
+	struct Entry {
+		PeerId peerId = 0;
+		MsgId minId = 0;
+		MsgId maxId = 0;
+		TimeId saved = 0;
+	};
+	struct Slice {
+		QVector<MTPMessage> messages;
+		QVector<MTPChat> chats;
+		QVector<MTPUser> users;
+	};
+
+	[[nodiscard]] static Slice ParseResult(
+		const MTPmessages_Messages &result);
+	[[nodiscard]] static QByteArray SerializeSlice(const Slice &slice);
+	[[nodiscard]] static std::optional<Slice> DeserializeSlice(
+		const QByteArray &serialized);
+	[[nodiscard]] static Slice MergeNewer(Slice &&older, Slice &&newer);
+
+	[[nodiscard]] QByteArray serializeIndex() const;
+	void readIndex(const QByteArray &serialized);
+	void preloadSlices();
+	void slicePreloaded(PeerId peerId, const QByteArray &serialized);
+
+	void write(PeerId peerId, Slice &&slice);
+	void remove(std::vector<Entry>::iterator i);
+	void forget(PeerId peerId);
+	void invalidateIf(Fn<bool(const Entry&)> condition);
+	void writeIndexDelayed();
+	void writeIndex();
+
+	const not_null<Data::Session*> _owner;
+
+	std::vector<Entry> _entries; // Most recently stored first.
+	base::flat_map<PeerId, Slice> _preloaded;
+	base::flat_map<PeerId, Slice> _shown;
+
+	// Ids of the messages shown from a slice until validate() checks them.
+	base::flat_map<PeerId, std::vector<MsgId>> _unvalidated;
+	base::Timer _writeIndexTimer;
+	std::vector<Fn<bool(const Entry&)>> _pendingInvalidations;
+	bool _indexRead = false;
+
+	rpl::lifetime _lifetime;
+
+};
+
+} // namespace Storage
@@ -8,6 +8,13 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_sparse_ids_list.h"
 
 namespace Storage {
+namespace {
+
+// Merging re-sorts the whole slice, so the few ids that come one by one
+// from new or loaded messages are inserted in place instead.
+constexpr auto kInsertOneByOneMax = 16;
+
+} // namespace
 
 SparseIdsList::Slice::Slice(
 	base::flat_set<MsgId> &&messages,
@@ -23,7 +30,15 @@ void SparseIdsList::Slice::merge(
 	Expects(moreNoSkipRange.from <= range.till);
 	Expects(range.from <= moreNoSkipRange.till);
 
-	messages.merge(std::begin(moreMessages), std::end(moreMessages));
+	const auto from = std::begin(moreMessages);
+	const auto till = std::end(moreMessages);
+	if (till - from <= kInsertOneByOneMax) {
+		for (auto i = from; i != till; ++i) {
+			messages.insert(*i);
+		}
+	} else {
+		messages.merge(from, till);
+	}
 	range = {
 		qMin(range.from, moreNoSkipRange.from),
 		qMax(range.till, moreNoSkipRange.till)